@@ -5,209 +5,1139 @@
 
 #include "fibo.h"
 
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
 #include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 #include <cassert>
 #include <string_view>
 #include <boost/operators.hpp>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FIBO_X86_KERNELS
+#endif
+
 
 using std::vector;
 
+namespace {
+	constexpr uint64_t EVEN_FIBITS = 0x5555555555555555;
+	constexpr uint64_t ODD_FIBITS = ~EVEN_FIBITS;
+
+	/** @brief Reverses the order of bits of a word.
+	 * @param[in] word   - word to reverse.
+	 * @return Word with bit i of @p word at position 63 - i.
+	 */
+	uint64_t reverse(uint64_t word) {
+		word = ((word >> 1) & EVEN_FIBITS) | ((word & EVEN_FIBITS) << 1);
+		word = ((word >> 2) & 0x3333333333333333) | ((word & 0x3333333333333333) << 2);
+		word = ((word >> 4) & 0x0F0F0F0F0F0F0F0F) | ((word & 0x0F0F0F0F0F0F0F0F) << 4);
+		return __builtin_bswap64(word);
+	}
+
+	/** @brief Kernel of one step of the addition.
+	 * Adds 2 * carries to sums, as 2F(n) = F(n + 1) + F(n - 2), for limbs [0, count).
+	 * Sum of the three fibits at every position is split into the fibit
+	 * left in sums and the carry stored in nextCarries. carries[-1] and
+	 * carries[count] are read as the neighbours of the first and last limb.
+	 */
+	using add_kernel = void (*)(uint64_t *sums, const uint64_t *carries, uint64_t *nextCarries, size_t count);
+
+	void add_scalar(uint64_t *sums, const uint64_t *carries, uint64_t *nextCarries, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			uint64_t up = (carries[i] << 1) | (carries[i - 1] >> 63);
+			uint64_t down = (carries[i] >> 2) | (carries[i + 1] << 62);
+			uint64_t sum = sums[i];
+			sums[i] = sum ^ up ^ down;
+			nextCarries[i] = (sum & up) | (down & (sum ^ up));
+		}
+	}
+
+#ifdef FIBO_X86_KERNELS
+	__attribute__((target("avx2")))
+	void add_avx2(uint64_t *sums, const uint64_t *carries, uint64_t *nextCarries, size_t count) {
+		const size_t limbsPerVector = sizeof(__m256i) / sizeof(uint64_t);
+
+		size_t i = 0;
+		for (; i + limbsPerVector <= count; i += limbsPerVector) {
+			auto *from = reinterpret_cast<const __m256i *>(carries + i);
+			auto *to = reinterpret_cast<__m256i *>(sums + i);
+			__m256i carry = _mm256_loadu_si256(from);
+			__m256i lower = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(carries + i - 1));
+			__m256i higher = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(carries + i + 1));
+			__m256i up = _mm256_or_si256(_mm256_slli_epi64(carry, 1), _mm256_srli_epi64(lower, 63));
+			__m256i down = _mm256_or_si256(_mm256_srli_epi64(carry, 2), _mm256_slli_epi64(higher, 62));
+			__m256i sum = _mm256_loadu_si256(to);
+			__m256i sumUp = _mm256_xor_si256(sum, up);
+			_mm256_storeu_si256(to, _mm256_xor_si256(sumUp, down));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(nextCarries + i),
+			                    _mm256_or_si256(_mm256_and_si256(sum, up), _mm256_and_si256(down, sumUp)));
+		}
+
+		add_scalar(sums + i, carries + i, nextCarries + i, count - i);
+	}
+#endif
+
+	/** @brief Chooses the widest kernel supported by the processor.
+	 * The choice can be forced with the FIBO_ADD_KERNEL environment variable
+	 * (scalar or avx2), which is used to compare the kernels.
+	 */
+	add_kernel select_add_kernel() {
+		const char *forced = getenv("FIBO_ADD_KERNEL");
+		if (forced != nullptr && strcmp(forced, "scalar") == 0) {
+			return add_scalar;
+		}
+
+#ifdef FIBO_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			return add_avx2;
+		}
+#endif
+
+		return add_scalar;
+	}
+
+	/** @brief Natural number in binary, the lowest word first, without zero words on top.
+	 * Intermediate representation of multiplication and division, value 0 has no words.
+	 */
+	using natural = vector<uint64_t>;
+
+	/** @brief Products of operands shorter than this many words are computed by the schoolbook method.
+	 */
+	constexpr size_t KARATSUBA_WORDS = 32;
+
+	/** @brief Divisions with quotient or divisor shorter than this many words are long divisions.
+	 */
+	constexpr size_t NEWTON_WORDS = 64;
+
+	/** @brief Fibonacci numbers F(0), ..., F(186), all that fit in two words.
+	 */
+	constexpr std::array<unsigned __int128, 187> FIBONACCI = [] {
+		std::array<unsigned __int128, 187> numbers{};
+		numbers[1] = 1;
+		for (size_t i = 2; i < numbers.size(); i++) {
+			numbers[i] = numbers[i - 1] + numbers[i - 2];
+		}
+		return numbers;
+	}();
+
+	void trim(natural &number) {
+		while (!number.empty() && number.back() == 0) {
+			number.pop_back();
+		}
+	}
+
+	natural from_wide(unsigned __int128 value) {
+		natural number = {uint64_t(value), uint64_t(value >> 64)};
+		trim(number);
+		return number;
+	}
+
+	size_t bit_length(const natural &number) {
+		return number.empty() ? 0 : number.size() * 64 - __builtin_clzll(number.back());
+	}
+
+	int compare(const natural &lhs, const natural &rhs) {
+		if (lhs.size() != rhs.size()) {
+			return lhs.size() < rhs.size() ? -1 : 1;
+		}
+		for (size_t i = lhs.size(); i-- > 0;) {
+			if (lhs[i] != rhs[i]) {
+				return lhs[i] < rhs[i] ? -1 : 1;
+			}
+		}
+		return 0;
+	}
+
+	/** @brief Adds words [0, fromSize) to words [0, toSize), fromSize <= toSize.
+	 * @return Carry out of the last word of @p to.
+	 */
+	uint64_t add_into(uint64_t *to, size_t toSize, const uint64_t *from, size_t fromSize) {
+		uint64_t carry = 0;
+		size_t i = 0;
+		for (; i < fromSize; i++) {
+			unsigned __int128 sum = (unsigned __int128) to[i] + from[i] + carry;
+			to[i] = uint64_t(sum);
+			carry = uint64_t(sum >> 64);
+		}
+		for (; carry != 0 && i < toSize; i++) {
+			carry = ++to[i] == 0;
+		}
+		return carry;
+	}
+
+	/** @brief Subtracts words [0, whatSize) from words [0, fromSize), whatSize <= fromSize.
+	 * @return Borrow out of the last word of @p from.
+	 */
+	uint64_t subtract_from(uint64_t *from, size_t fromSize, const uint64_t *what, size_t whatSize) {
+		uint64_t borrow = 0;
+		size_t i = 0;
+		for (; i < whatSize; i++) {
+			uint64_t word = from[i];
+			from[i] = word - what[i] - borrow;
+			borrow = word < what[i] || word - what[i] < borrow;
+		}
+		for (; borrow != 0 && i < fromSize; i++) {
+			borrow = from[i]-- == 0;
+		}
+		return borrow;
+	}
+
+	natural add(natural lhs, const natural &rhs) {
+		lhs.resize(std::max(lhs.size(), rhs.size()) + 1, 0);
+		add_into(lhs.data(), lhs.size(), rhs.data(), rhs.size());
+		trim(lhs);
+		return lhs;
+	}
+
+	/** @brief Difference lhs - rhs, where rhs <= lhs.
+	 */
+	natural subtract(natural lhs, const natural &rhs) {
+		assert(compare(lhs, rhs) >= 0);
+		subtract_from(lhs.data(), lhs.size(), rhs.data(), rhs.size());
+		trim(lhs);
+		return lhs;
+	}
+
+	natural shift_left(const natural &number, size_t bits) {
+		if (number.empty()) {
+			return number;
+		}
+		size_t wordShift = bits / 64;
+		unsigned bitShift = bits % 64;
+		natural shifted(number.size() + wordShift + 1, 0);
+		for (size_t i = 0; i < number.size(); i++) {
+			shifted[i + wordShift] |= number[i] << bitShift;
+			if (bitShift != 0) {
+				shifted[i + wordShift + 1] = number[i] >> (64 - bitShift);
+			}
+		}
+		trim(shifted);
+		return shifted;
+	}
+
+	natural shift_right(const natural &number, size_t bits) {
+		size_t wordShift = bits / 64;
+		unsigned bitShift = bits % 64;
+		if (wordShift >= number.size()) {
+			return {};
+		}
+		natural shifted(number.size() - wordShift);
+		for (size_t i = 0; i < shifted.size(); i++) {
+			shifted[i] = number[i + wordShift] >> bitShift;
+			if (bitShift != 0 && i + wordShift + 1 < number.size()) {
+				shifted[i] |= number[i + wordShift + 1] << (64 - bitShift);
+			}
+		}
+		trim(shifted);
+		return shifted;
+	}
+
+	/** @brief Writes the product of words [0, aSize) and [0, bSize) to words [0, aSize + bSize) of product.
+	 * Operands of similar length are split in halves by Karatsuba's method, which needs three
+	 * products of halves instead of four. Longer operand is cut into pieces of the length of the shorter.
+	 */
+	void multiply_into(const uint64_t *a, size_t aSize, const uint64_t *b, size_t bSize, uint64_t *product) {
+		if (aSize < bSize) {
+			std::swap(a, b);
+			std::swap(aSize, bSize);
+		}
+
+		if (bSize < KARATSUBA_WORDS) {
+			std::fill(product, product + aSize + bSize, 0);
+			for (size_t i = 0; i < bSize; i++) {
+				uint64_t carry = 0;
+				for (size_t j = 0; j < aSize; j++) {
+					unsigned __int128 term = (unsigned __int128) a[j] * b[i] + product[i + j] + carry;
+					product[i + j] = uint64_t(term);
+					carry = uint64_t(term >> 64);
+				}
+				product[i + aSize] = carry;
+			}
+			return;
+		}
+
+		if (2 * bSize <= aSize) {
+			std::fill(product, product + aSize + bSize, 0);
+			vector<uint64_t> piece(2 * bSize);
+			for (size_t start = 0; start < aSize; start += bSize) {
+				size_t pieceSize = std::min(bSize, aSize - start);
+				multiply_into(a + start, pieceSize, b, bSize, piece.data());
+				add_into(product + start, aSize + bSize - start, piece.data(), pieceSize + bSize);
+			}
+			return;
+		}
+
+		// a = a1 B^h + a0, b = b1 B^h + b0: ab = a1b1 B^2h + ((a0 + a1)(b0 + b1) - a0b0 - a1b1) B^h + a0b0.
+		size_t half = (aSize + 1) / 2;
+		size_t aHigh = aSize - half;
+		size_t bHigh = bSize - half;
+		multiply_into(a, half, b, half, product);
+		multiply_into(a + half, aHigh, b + half, bHigh, product + 2 * half);
+
+		vector<uint64_t> sums(2 * (half + 1));
+		uint64_t *aSum = sums.data();
+		uint64_t *bSum = aSum + half + 1;
+		std::copy(a, a + half, aSum);
+		aSum[half] = add_into(aSum, half, a + half, aHigh);
+		std::copy(b, b + half, bSum);
+		bSum[half] = add_into(bSum, half, b + half, bHigh);
+
+		vector<uint64_t> middle(2 * (half + 1));
+		multiply_into(aSum, half + 1, bSum, half + 1, middle.data());
+		subtract_from(middle.data(), middle.size(), product, 2 * half);
+		subtract_from(middle.data(), middle.size(), product + 2 * half, aHigh + bHigh);
+		size_t middleSize = std::min(middle.size(), aSize + bSize - half);
+		add_into(product + half, aSize + bSize - half, middle.data(), middleSize);
+	}
+
+	natural multiply(const natural &lhs, const natural &rhs) {
+		if (lhs.empty() || rhs.empty()) {
+			return {};
+		}
+		natural product(lhs.size() + rhs.size());
+		multiply_into(lhs.data(), lhs.size(), rhs.data(), rhs.size(), product.data());
+		trim(product);
+		return product;
+	}
+
+	/** @brief Quotient and remainder by long division, Knuth's algorithm D.
+	 */
+	std::pair<natural, natural> long_divide(const natural &dividend, const natural &divisor) {
+		assert(!divisor.empty());
+		if (divisor.size() == 1) {
+			natural quotient(dividend.size());
+			unsigned __int128 remainder = 0;
+			for (size_t i = dividend.size(); i-- > 0;) {
+				unsigned __int128 current = (remainder << 64) | dividend[i];
+				quotient[i] = uint64_t(current / divisor[0]);
+				remainder = current % divisor[0];
+			}
+			trim(quotient);
+			return {quotient, from_wide(remainder)};
+		}
+
+		// Najwyzszy bit dzielnika rowny 1, wtedy cyfra ilorazu z dwoch najwyzszych cyfr myli sie najwyzej o 2.
+		unsigned shift = __builtin_clzll(divisor.back());
+		natural rest = shift_left(dividend, shift);
+		rest.resize(dividend.size() + 1, 0);
+		natural by = shift_left(divisor, shift);
+		size_t size = by.size();
+		natural quotient(rest.size() - size, 0);
+
+		for (size_t j = quotient.size(); j-- > 0;) {
+			unsigned __int128 top = ((unsigned __int128) rest[j + size] << 64) | rest[j + size - 1];
+			unsigned __int128 digit = top / by[size - 1];
+			unsigned __int128 digitRest = top % by[size - 1];
+			while ((digit >> 64) != 0 || digit * by[size - 2] > ((digitRest << 64) | rest[j + size - 2])) {
+				digit--;
+				digitRest += by[size - 1];
+				if ((digitRest >> 64) != 0) {
+					break;
+				}
+			}
+
+			uint64_t carry = 0;
+			uint64_t borrow = 0;
+			for (size_t i = 0; i <= size; i++) {
+				unsigned __int128 term = i < size ? digit * by[i] + carry : carry;
+				carry = uint64_t(term >> 64);
+				uint64_t word = rest[i + j];
+				uint64_t low = uint64_t(term);
+				rest[i + j] = word - low - borrow;
+				borrow = word < low || word - low < borrow;
+			}
+			if (borrow != 0) {
+				digit--;
+				add_into(rest.data() + j, size + 1, by.data(), size);
+			}
+			quotient[j] = uint64_t(digit);
+		}
+
+		rest.resize(size);
+		trim(quotient);
+		return {quotient, shift_right(rest, shift)};
+	}
+
+	/** @brief About 2^(bit length of divisor + precision) / divisor, relative error about 2^-precision.
+	 * Newton's iteration x' = x + x (1 - divisor x) doubles the precision of the estimate of a half
+	 * precision, which needs only the highest precision + 64 bits of the divisor.
+	 */
+	natural reciprocal(const natural &divisor, size_t precision) {
+		size_t length = bit_length(divisor);
+		size_t cut = length > precision + 64 ? length - precision - 64 : 0;
+		natural top = shift_right(divisor, cut);
+		size_t scale = length - cut + precision;
+		natural power = shift_left(natural{1}, scale);
+		if (precision <= NEWTON_WORDS * 64) {
+			return long_divide(power, top).first;
+		}
+
+		size_t half = precision / 2 + 64;
+		natural estimate = shift_left(reciprocal(divisor, half), precision - half);
+		natural product = multiply(top, estimate);
+		if (compare(product, power) <= 0) {
+			return add(estimate, shift_right(multiply(estimate, subtract(power, product)), scale));
+		}
+		return subtract(estimate, shift_right(multiply(estimate, subtract(product, power)), scale));
+	}
+
+	/** @brief Quotient and remainder of division of naturals, divisor != 0.
+	 * Long quotients by long divisors are multiplied by the reciprocal of the divisor and corrected.
+	 */
+	std::pair<natural, natural> divide(const natural &dividend, const natural &divisor) {
+		assert(!divisor.empty());
+		if (compare(dividend, divisor) < 0) {
+			return {{}, dividend};
+		}
+		if (divisor.size() < NEWTON_WORDS || dividend.size() - divisor.size() < NEWTON_WORDS) {
+			return long_divide(dividend, divisor);
+		}
+
+		size_t divisorLength = bit_length(divisor);
+		size_t dividendLength = bit_length(dividend);
+		size_t precision = dividendLength - divisorLength + 64;
+		// Nizsze bity dzielnej zmieniaja iloraz o mniej niz 2^-64.
+		size_t cut = dividendLength > precision + 64 ? dividendLength - precision - 64 : 0;
+		natural quotient = shift_right(multiply(shift_right(dividend, cut), reciprocal(divisor, precision)),
+		                               divisorLength + precision - cut);
+
+		natural product = multiply(quotient, divisor);
+		while (compare(product, dividend) > 0) {
+			quotient = subtract(quotient, natural{1});
+			product = subtract(product, divisor);
+		}
+		natural remainder = subtract(dividend, product);
+		while (compare(remainder, divisor) >= 0) {
+			quotient = add(quotient, natural{1});
+			remainder = subtract(remainder, divisor);
+		}
+		return {quotient, remainder};
+	}
+
+	/** @brief Fibonacci numbers F(n) and F(n + 1), computed by doubling of the index.
+	 */
+	std::pair<natural, natural> fibonacci(size_t n) {
+		natural current;
+		natural next{1};
+		for (size_t bit = n == 0 ? 0 : std::numeric_limits<size_t>::digits - __builtin_clzll(n); bit-- > 0;) {
+			// F(2k) = F(k) (2F(k + 1) - F(k)), F(2k + 1) = F(k)^2 + F(k + 1)^2.
+			natural doubled = multiply(current, subtract(shift_left(next, 1), current));
+			natural doubledNext = add(multiply(current, current), multiply(next, next));
+			if (((n >> bit) & 1) != 0) {
+				current = doubledNext;
+				next = add(doubled, doubledNext);
+			} else {
+				current = doubled;
+				next = doubledNext;
+			}
+		}
+		return {current, next};
+	}
+
+	/** @brief Decimal digits held in a word, 10^19 < 2^64.
+	 */
+	constexpr size_t WORD_DIGITS = 19;
+
+	constexpr uint64_t WORD_POWER = 10'000'000'000'000'000'000u;
+
+	/** @brief Words with the highest power of ten below which the schoolbook conversion is used.
+	 */
+	constexpr size_t SCHOOLBOOK_DECIMAL_WORDS = 16;
+
+	/** @brief Powers 10^(19 * 2^k) for k = 0, 1, ... while at most limit.
+	 */
+	vector<natural> decimal_powers(const natural &limit) {
+		vector<natural> powers{natural{WORD_POWER}};
+		while (compare(powers.back(), limit) <= 0) {
+			powers.push_back(multiply(powers.back(), powers.back()));
+		}
+		return powers;
+	}
+
+	natural decimal_value(std::string_view digits) {
+		// Slowa po 19 cyfr od konca, potem pary sasiednich liczb h 10^(19 * 2^k) + l, az zostanie jedna.
+		vector<natural> parts;
+		for (size_t end = digits.size(); end > 0; end -= std::min(end, WORD_DIGITS)) {
+			uint64_t word = 0;
+			for (size_t i = end - std::min(end, WORD_DIGITS); i < end; i++) {
+				assert(digits[i] >= '0' && digits[i] <= '9');
+				word = 10 * word + (digits[i] - '0');
+			}
+			parts.push_back(word == 0 ? natural{} : natural{word});
+		}
+
+		natural power{WORD_POWER};
+		while (parts.size() > 1) {
+			for (size_t i = 0; i < parts.size(); i += 2) {
+				parts[i / 2] = i + 1 < parts.size() ? add(multiply(parts[i + 1], power), parts[i]) : parts[i];
+			}
+			parts.resize((parts.size() + 1) / 2);
+			if (parts.size() > 1) {
+				power = multiply(power, power);
+			}
+		}
+		return parts.empty() ? natural{} : parts[0];
+	}
+
+	/** @brief Writes value < 10^(19 * 2^level) as exactly 19 * 2^level digits, leading zeros included.
+	 * Value is split by division by powers[level - 1] into halves written separately.
+	 */
+	void write_decimal(const natural &value, const vector<natural> &powers, size_t level, char *digits) {
+		size_t count = WORD_DIGITS << level;
+		if (powers[level].size() <= SCHOOLBOOK_DECIMAL_WORDS) {
+			natural rest = value;
+			for (size_t end = count; end > 0; end -= WORD_DIGITS) {
+				auto [quotient, remainder] = long_divide(rest, natural{WORD_POWER});
+				uint64_t word = remainder.empty() ? 0 : remainder[0];
+				for (size_t i = end; i-- > end - WORD_DIGITS;) {
+					digits[i] = char('0' + word % 10);
+					word /= 10;
+				}
+				rest = std::move(quotient);
+			}
+			return;
+		}
+
+		auto [quotient, remainder] = divide(value, powers[level - 1]);
+		write_decimal(quotient, powers, level - 1, digits);
+		write_decimal(remainder, powers, level - 1, digits + count / 2);
+	}
+
+	std::string decimal_digits(const natural &value) {
+		vector<natural> powers = decimal_powers(value);
+		std::string digits(WORD_DIGITS << (powers.size() - 1), '0');
+		write_decimal(value, powers, powers.size() - 1, digits.data());
+		size_t first = std::min(digits.find_first_not_of('0'), digits.size() - 1);
+		return digits.substr(first);
+	}
+
+	natural binary_value(std::string_view digits) {
+		natural value((digits.size() + 63) / 64, 0);
+		size_t pos = 0;
+		for (auto it = digits.crbegin(); it != digits.crend(); it++, pos++) {
+			assert(*it == '0' || *it == '1');
+			value[pos / 64] |= uint64_t(*it == '1') << (pos % 64);
+		}
+		trim(value);
+		return value;
+	}
+
+	std::string binary_digits(const natural &value) {
+		if (value.empty()) {
+			return "0";
+		}
+		std::string digits(bit_length(value), '0');
+		for (size_t pos = 0; pos < digits.size(); pos++) {
+			if (((value[pos / 64] >> (pos % 64)) & 1) != 0) {
+				digits[digits.size() - 1 - pos] = '1';
+			}
+		}
+		return digits;
+	}
+}
+
+Fibo::limb_vector::limb_vector(const limb_vector &rhs) : limb_vector() {
+	*this = rhs;
+}
+
+Fibo::limb_vector::limb_vector(limb_vector &&rhs) noexcept : limb_vector() {
+	*this = std::move(rhs);
+}
+
+Fibo::limb_vector &Fibo::limb_vector::operator=(const limb_vector &rhs) {
+	if (this != &rhs) {
+		count = 0;
+		reserve(rhs.count);
+		std::copy(rhs.words, rhs.words + rhs.count, words);
+		count = rhs.count;
+	}
+	return *this;
+}
+
+Fibo::limb_vector &Fibo::limb_vector::operator=(limb_vector &&rhs) noexcept {
+	if (this == &rhs) {
+		return *this;
+	}
+	if (rhs.words == rhs.inlineWords) {
+		// Miesci sie w kazdym wektorze.
+		std::copy(rhs.words, rhs.words + rhs.count, words);
+		count = rhs.count;
+	} else {
+		if (words != inlineWords) {
+			delete[] words;
+		}
+		words = rhs.words;
+		count = rhs.count;
+		capacity = rhs.capacity;
+		rhs.words = rhs.inlineWords;
+		rhs.capacity = INLINE_LIMBS;
+	}
+	rhs.count = 0;
+	return *this;
+}
+
+Fibo::limb_vector::~limb_vector() {
+	if (words != inlineWords) {
+		delete[] words;
+	}
+}
+
+void Fibo::limb_vector::reserve(size_t newCapacity) {
+	if (newCapacity <= capacity) {
+		return;
+	}
+	newCapacity = std::max(newCapacity, 2 * capacity);
+	limb *grown = new limb[newCapacity];
+	std::copy(words, words + count, grown);
+	if (words != inlineWords) {
+		delete[] words;
+	}
+	words = grown;
+	capacity = newCapacity;
+}
+
+void Fibo::limb_vector::resize(size_t newSize, limb value) {
+	reserve(newSize);
+	if (newSize > count) {
+		std::fill(words + count, words + newSize, value);
+	}
+	count = newSize;
+}
+
+void Fibo::limb_vector::push_back(limb value) {
+	reserve(count + 1);
+	words[count++] = value;
+}
+
+bool Fibo::limb_vector::operator==(const limb_vector &rhs) const {
+	return count == rhs.count && std::equal(words, words + count, rhs.words);
+}
+
+size_t Fibo::normalize_runs() {
+	// Run k jedynek od pozycji p jest rowny fibitom p + k, p + k - 2, ... do p + 2 oraz p dla nieparzystego k.
+	// Wzorzec zaczyna sie od gory runa, a dodawanie przenosi w gore, wiec limby sa odwrocone i brane od
+	// najwyzszego. Bity p + k - 2, ... to bity w nieparzystej odleglosci od poczatku odwroconego runa:
+	// dodanie jedynek na parzystych poczatkach czysci wlasnie te runy.
+	size_t size = limbs.size();
+	limb spill = 0;
+	limb higher = 0;
+	limb higherOdd = 0;
+	limb carry = 0;
+	size_t pairs = 0;
+	for (size_t m = 0; m <= size; m++) {
+		limb current = m < size ? reverse(limbs[size - 1 - m]) : 0;
+		limb starts = current & ~((current << 1) | (higher >> (LIMB_BITS - 1)));
+		limb sum = current + (starts & EVEN_FIBITS);
+		limb overflow = sum < current;
+		sum += carry;
+		carry = overflow | (sum < carry);
+		limb evenStartRuns = current & ~sum;
+		limb odd = current & (evenStartRuns ^ EVEN_FIBITS);
+
+		limb ends = higher & ~((higher >> 1) | (current << (LIMB_BITS - 1)));
+		limb runs = reverse((higherOdd >> 2) | (odd << (LIMB_BITS - 2)) | (ends & ~higherOdd));
+		(m == 0 ? spill : limbs[size - m]) = runs;
+		pairs += __builtin_popcountll(runs & (runs >> 1));
+
+		higher = current;
+		higherOdd = odd;
+	}
+	if (spill != 0) {
+		limbs.push_back(spill);
+	}
+
+	return pairs;
+}
+
 void Fibo::normalize() {
-	for (auto i = length() - 1; i-- > 0;) {
-		normalize(i);
+	// Kolejne przejscia lacza runy stykajace sie po poprzednim, dopoki par jest duzo.
+	while (normalize_runs() > limbs.size()) {
+	}
+
+	// Zostaly pary na styku sasiednich runow. Od gory, zawsze najwyzsza para: powyzej niej postac jest juz
+	// unormowana.
+	for (size_t i = limbs.size(); i-- > 0;) {
+		for (limb pairs = adjacent(i); pairs != 0; pairs = adjacent(i)) {
+			normalize(i * LIMB_BITS + LIMB_BITS - 1 - __builtin_clzll(pairs));
+		}
 	}
 
 	trim();
 }
 
 inline void Fibo::normalize(size_t pos) {
-	size_t size = length();
-	while (pos + 1 < size && value[pos] && value[pos + 1]) {
-		value[pos] = false;
-		value[pos + 1] = false;
-		if (pos + 2 < size) {
-			assert(!value[pos + 2]);
-			value[pos + 2] = true;
-		} else {
-			value.push_back(true);
-			break;
-			// Na pewno nie ma co normalizowaÄ.
+	assert((*this)[pos] && (*this)[pos + 1]);
+	// Pary (pos, pos + 1), (pos + 2, pos + 3), ... lancucha 1010...11 znikaja naraz: pozycje parzystosci
+	// pos dopelniamy jedynkami i dodajemy 1 na pos. Przeniesienie zatrzymuje sie na end, pierwszej pozycji
+	// spoza lancucha, jedynka trafia na end - 1.
+	limb fill = pos % 2 == 0 ? EVEN_FIBITS : ODD_FIBITS;
+	limb carry = limb(1) << (pos % LIMB_BITS);
+	for (size_t i = pos / LIMB_BITS;; i++) {
+		if (i == limbs.size()) {
+			limbs.push_back(0);
 		}
-		pos += 2;
+		limb filled = limbs[i] | fill;
+		limb sum = filled + carry;
+		limb changed = filled ^ sum;
+		limbs[i] &= ~changed;
+		if (sum > filled) {
+			size_t end = i * LIMB_BITS + __builtin_ctzll(changed & ~(changed >> 1));
+			set(end - 1, true);
+			return;
+		}
+		carry = 1;
 	}
 }
 
 void Fibo::trim() {
-	while (value.size() > 1 && value.back() == false) {
-		value.pop_back();
+	while (!limbs.empty() && limbs.back() == 0) {
+		limbs.pop_back();
 	}
 }
 
 void Fibo::upsize(const Fibo &rhs) {
-	value.resize(std::max(length(), rhs.length()), false);
+	if (limbs.size() < rhs.limbs.size()) {
+		limbs.resize(rhs.limbs.size(), 0);
+	}
 }
 
 bool Fibo::operator[](size_t pos) const {
-	if (pos >= length()) {
+	if (pos / LIMB_BITS >= limbs.size()) {
 		return false;
 	}
-	return value[pos];
+	return (limbs[pos / LIMB_BITS] >> (pos % LIMB_BITS)) & 1;
+}
+
+void Fibo::set(size_t pos, bool fibit) {
+	size_t index = pos / LIMB_BITS;
+	if (index >= limbs.size()) {
+		if (!fibit) {
+			return;
+		}
+		limbs.resize(index + 1, 0);
+	}
+	limb mask = limb(1) << (pos % LIMB_BITS);
+	limbs[index] = fibit ? limbs[index] | mask : limbs[index] & ~mask;
+}
+
+Fibo::limb Fibo::adjacent(size_t index) const {
+	limb next = index + 1 < limbs.size() ? limbs[index + 1] : 0;
+	return limbs[index] & ((limbs[index] >> 1) | (next << (LIMB_BITS - 1)));
+}
+
+class Fibo::converter {
+private:
+	/** @brief Fibonacci numbers around F(m), for normalized forms split at fibit m.
+	 */
+	struct split {
+		natural previous; // F(m - 1)
+		natural current; // F(m)
+		natural next; // F(m + 1)
+		natural afterNext; // F(m + 2)
+		natural lucas; // L(m) = F(m - 1) + F(m + 1)
+		natural inverse; // about 2^inverseScale / L(m), computed when first needed
+		size_t inverseScale;
+	};
+
+	/** @brief Splits up to this many fibits are kept by the thread for all conversions.
+	 */
+	static constexpr size_t SHARED_SPLIT_FIBITS = 64 * LIMB_BITS;
+
+	std::map<size_t, split> splits;
+
+	split &at(size_t m) {
+		// Male splity sa wspolne dla konwersji w watku, duze tylko dla jednej, by nie zostawaly w pamieci.
+		static thread_local std::map<size_t, split> sharedSplits;
+		std::map<size_t, split> &cache = m <= SHARED_SPLIT_FIBITS ? sharedSplits : splits;
+		auto found = cache.find(m);
+		if (found != cache.end()) {
+			return found->second;
+		}
+		split numbers;
+		std::tie(numbers.current, numbers.next) = fibonacci(m);
+		numbers.previous = subtract(numbers.next, numbers.current);
+		numbers.afterNext = add(numbers.current, numbers.next);
+		numbers.lucas = add(numbers.previous, numbers.next);
+		return cache.emplace(m, std::move(numbers)).first->second;
+	}
+
+public:
+	/** @brief Value of fibits [0, 64 count) and, if withShifted, value of them shifted left by 1.
+	 * As F(m + j + 2) = F(m) F(j + 3) + F(m - 1) F(j + 2), value of the upper half shifted by
+	 * m fibits follows from both values of the upper half, so halves are converted separately.
+	 */
+	std::pair<natural, natural> value(const limb *fibits, size_t count, bool withShifted) {
+		if (count == 0) {
+			return {};
+		}
+		if (count <= 2) {
+			// Wartosci sa mniejsze od F(133), wiec mieszcza sie w dwoch slowach.
+			unsigned __int128 value = 0;
+			unsigned __int128 shifted = 0;
+			for (size_t i = 0; i < count; i++) {
+				for (limb rest = fibits[i]; rest != 0; rest &= rest - 1) {
+					size_t pos = i * LIMB_BITS + __builtin_ctzll(rest);
+					value += FIBONACCI[pos + 2];
+					shifted += FIBONACCI[pos + 3];
+				}
+			}
+			return {from_wide(value), from_wide(shifted)};
+		}
+
+		size_t half = count / 2;
+		const split &numbers = at(half * LIMB_BITS);
+		auto [lowValue, lowShifted] = value(fibits, half, withShifted);
+		auto [highValue, highShifted] = value(fibits + half, count - half, true);
+		natural value = add(add(multiply(numbers.current, highShifted), multiply(numbers.previous, highValue)), lowValue);
+		if (!withShifted) {
+			return {value, {}};
+		}
+		natural shifted = add(add(multiply(numbers.next, highShifted), multiply(numbers.current, highValue)), lowShifted);
+		return {value, shifted};
+	}
+
+	/** @brief Fibo with given value, sets *shifted, if given, to the value of its form shifted left by 1.
+	 * Normalized form split at fibit m has upper half H with the greatest value Q such that
+	 * F(m) s(Q) + F(m - 1) Q <= value, where s(Q) is the value of H shifted left by 1. Q is close
+	 * to value / phi^m, so to value / L(m) for Q of at most m fibits, and differs from it by a few units.
+	 */
+	Fibo fibo(const natural &value, natural *shifted) {
+		if (bit_length(value) <= 2 * 64 - 2) {
+			// Wartosc przesunieta jest mniejsza od 2 * value, wiec tez miesci sie w dwoch slowach.
+			Fibo result;
+			unsigned __int128 rest = value.empty() ? 0 : value[0];
+			if (value.size() == 2) {
+				rest |= (unsigned __int128) value[1] << 64;
+			}
+			unsigned __int128 shiftedValue = 0;
+			for (size_t pos = FIBONACCI.size() - 3; rest != 0; pos--) {
+				if (FIBONACCI[pos + 2] <= rest) {
+					rest -= FIBONACCI[pos + 2];
+					result.set(pos, true);
+					shiftedValue += FIBONACCI[pos + 3];
+				}
+			}
+			if (shifted != nullptr) {
+				*shifted = from_wide(shiftedValue);
+			}
+			return result;
+		}
+
+		// Postac ma okolo log_phi 2 = 1.4404 fibitu na bit. Dzielimy ja na granicy limbow nie ponizej polowy:
+		// wtedy Q ma najwyzej m fibitow, a value / L(m) rozni sie od value / phi^m o mniej niz phi^-m.
+		size_t fibits = bit_length(value) * 14404 / 10000 + 2;
+		size_t m = (fibits + 2 * LIMB_BITS - 1) / (2 * LIMB_BITS) * LIMB_BITS;
+		// Dolna polowa musi byc mniejsza od value, czyli value >= F(m + 2). Dla m = 64 zachodzi, bo value >= 2^126.
+		while (m > LIMB_BITS && compare(value, at(m).afterNext) < 0) {
+			m -= LIMB_BITS;
+		}
+		split &numbers = at(m);
+		if (numbers.inverse.empty()) {
+			// Wystarcza dla ilorazow do m fibitow, czyli do m bitow.
+			numbers.inverse = reciprocal(numbers.lucas, m + LIMB_BITS);
+			numbers.inverseScale = bit_length(numbers.lucas) + m + LIMB_BITS;
+		}
+
+		// Oszacowanie zmniejszone o 1, zeby poprawki byly zwykle tanszymi zwiekszeniami Q.
+		natural quotient = shift_right(multiply(value, numbers.inverse), numbers.inverseScale);
+		if (!quotient.empty()) {
+			quotient = subtract(quotient, natural{1});
+		}
+		natural highShifted;
+		Fibo high = fibo(quotient, &highShifted);
+		natural bottom = add(multiply(numbers.current, highShifted), multiply(numbers.previous, quotient));
+
+		// s(Q + 1) - s(Q) jest rowne 1, gdy najnizszy fibit Q jest jedynka, i 2 w przeciwnym razie.
+		while (compare(bottom, value) > 0) {
+			high -= One();
+			quotient = subtract(quotient, natural{1});
+			highShifted = subtract(highShifted, natural{high[0] ? 1u : 2u});
+			bottom = subtract(bottom, high[0] ? numbers.next : numbers.afterNext);
+		}
+		natural rest = subtract(value, bottom);
+		while (compare(rest, high[0] ? numbers.next : numbers.afterNext) >= 0) {
+			rest = subtract(rest, high[0] ? numbers.next : numbers.afterNext);
+			highShifted = add(highShifted, natural{high[0] ? 1u : 2u});
+			quotient = add(quotient, natural{1});
+			high += One();
+		}
+
+		natural lowShifted;
+		Fibo low = fibo(rest, shifted != nullptr ? &lowShifted : nullptr);
+		if (shifted != nullptr) {
+			*shifted = add(add(multiply(numbers.next, highShifted), multiply(numbers.current, quotient)), lowShifted);
+		}
+
+		if (!high.limbs.empty()) {
+			low.limbs.resize(m / LIMB_BITS + high.limbs.size(), 0);
+			std::copy(high.limbs.begin(), high.limbs.end(), low.limbs.begin() + m / LIMB_BITS);
+		}
+		return low;
+	}
+};
+
+std::vector<Fibo::limb> Fibo::to_natural() const {
+	return converter().value(limbs.data(), limbs.size(), false).first;
+}
+
+Fibo Fibo::from_natural(const std::vector<limb> &value) {
+	return converter().fibo(value, nullptr);
+}
+
+unsigned __int128 Fibo::small_value() const {
+	assert(limbs.size() <= INLINE_LIMBS);
+	unsigned __int128 value = 0;
+	for (size_t i = 0; i < limbs.size(); i++) {
+		for (limb rest = limbs[i]; rest != 0; rest &= rest - 1) {
+			value += FIBONACCI[i * LIMB_BITS + __builtin_ctzll(rest) + 2];
+		}
+	}
+	return value;
 }
 
-Fibo::Fibo() : value({false}) {}
+Fibo Fibo::from_decimal(const std::string_view &str) {
+	assert(!str.empty());
+	return from_natural(decimal_value(str));
+}
+
+std::string Fibo::to_decimal() const {
+	return decimal_digits(to_natural());
+}
+
+Fibo Fibo::from_binary(const std::string_view &str) {
+	assert(!str.empty());
+	return from_natural(binary_value(str));
+}
+
+std::string Fibo::to_binary() const {
+	return binary_digits(to_natural());
+}
 
 Fibo::Fibo(const std::string_view &str) {
 	assert(!str.empty()); // Czy jest niepusta.
 	assert(!(str.size() == 1 && str[0] == '0')); // Czy nie ma wiodÄcego zera.
-	for (auto it = str.crbegin(); it != str.crend(); it++) {
+	limbs.resize((str.size() + LIMB_BITS - 1) / LIMB_BITS, 0);
+	size_t pos = 0;
+	for (auto it = str.crbegin(); it != str.crend(); it++, pos++) {
 		assert(*it == '0' || *it == '1');
-		value.push_back(*it == '1');
+		limbs[pos / LIMB_BITS] |= limb(*it == '1') << (pos % LIMB_BITS);
 	}
 	normalize();
 }
 
 bool operator<(const Fibo &lhs, const Fibo &rhs) {
-	if (lhs.length() != rhs.length()) {
-		return lhs.length() < rhs.length();
+	if (lhs.limbs.size() != rhs.limbs.size()) {
+		return lhs.limbs.size() < rhs.limbs.size();
 	}
-	for (size_t i = lhs.length(); i-- > 0;) {
-		if (lhs.value[i] != rhs.value[i]) {
-			return lhs.value[i] < rhs.value[i];
+	for (size_t i = lhs.limbs.size(); i-- > 0;) {
+		if (lhs.limbs[i] != rhs.limbs[i]) {
+			return lhs.limbs[i] < rhs.limbs[i];
 		}
 	}
 	return false;
 }
 
 bool operator==(const Fibo &lhs, const Fibo &rhs) {
-	return lhs.value == rhs.value;
+	return lhs.limbs == rhs.limbs;
 }
 
 Fibo &Fibo::operator+=(const Fibo &rhs) {
-	// Rozszerzenie do length + 1 Ĺźeby mĂłc pojedynczo znormalizowaÄ i 2 Ĺźeby mĂłc wpisaÄ wartoĹÄi w ostatnim kroku.
-	value.resize(std::max(std::max(length(), rhs.length()) + 1, 2UL), false);
-	size_t start = std::max(rhs.length() - 1, 1UL);
-	assert(start < value.size());
+	vector<limb> buffers;
+	accumulate(rhs, buffers);
+	normalize();
+	return *this;
+}
 
-	unsigned short int acc[3];
-	acc[1] = value[start] + rhs[start];
-	acc[2] = value[start - 1] + rhs[start - 1];
+void Fibo::accumulate(const Fibo &rhs, vector<limb> &buffers) {
+	static const add_kernel add = select_add_kernel();
 
-	for (size_t pos = start; pos >= 2; pos--) {
-		acc[0] = acc[1];
-		acc[1] = acc[2];
-		acc[2] = value[pos - 2] + rhs[pos - 2];
+	// a + b = (a ^ b) + 2 (a & b). Krok dodaje podwojone przeniesienia do sumy wszystkich limbow naraz
+	// i zostawia nowe tam, gdzie spotkaly sie dwie jedynki, az nie bedzie zadnych. Przeniesienia
+	// przesuwaja sie o najwyzej limb na krok, wiec krok obejmuje tylko limby wokol nich.
+	// Suma liczb o najwyzej n fibitach ma najwyzej n + 2 fibity, a nieunormowanych n + 3, podobnie posrednie
+	// sumy i przeniesienia.
+	size_t rhsSize = rhs.limbs.size();
+	size_t size = (std::max(length(), rhs.length()) + 3 + LIMB_BITS - 1) / LIMB_BITS;
+	limbs.resize(size, 0);
 
-		if (acc[0] > 0 && value[pos + 1]) {
-			acc[0]--;
-			value[pos + 1] = false;
-			assert(value[pos + 2] == false);
-			value[pos + 2] = true;
+	// Dwa bufory przeniesien z zerowym limbem po obu stronach, dla malych liczb na stosie.
+	limb smallBuffers[2 * (INLINE_LIMBS + 2)] = {};
+	if (size > INLINE_LIMBS) {
+		buffers.assign(2 * (size + 2), 0);
+	}
+	limb *carries = (size > INLINE_LIMBS ? buffers.data() : smallBuffers) + 1;
+	limb *nextCarries = carries + size + 2;
+	for (size_t i = 0; i < rhsSize; i++) {
+		carries[i] = limbs[i] & rhs.limbs[i];
+		limbs[i] ^= rhs.limbs[i];
+	}
+
+	size_t low = 0;
+	size_t high = rhsSize;
+	while (true) {
+		while (low < high && carries[low] == 0) {
+			low++;
+		}
+		while (high > low && carries[high - 1] == 0) {
+			high--;
 		}
-		if (acc[0] >= 2) {
-			acc[0] -= 2;
-			acc[2]++;
-			assert(value[pos + 1] == false);
-			value[pos + 1] = true;
+		if (low == high) {
+			break;
 		}
 
-		assert(acc[0] <= 1);
-		value[pos] = acc[0];
-		acc[0] = 0;
+		low = low > 0 ? low - 1 : 0;
+		high = std::min(high + 1, size);
+		// 2F(3) = F(4) + F(2): przeniesienie z pozycji 1 daje jedynke na pozycji 0, a nie -1.
+		carries[-1] = (carries[0] & 2) << (LIMB_BITS - 2);
+		add(limbs.data() + low, carries + low, nextCarries + low, high - low);
+		carries[-1] = 0;
+		std::fill(carries + low, carries + high, 0);
+		std::swap(carries, nextCarries);
 	}
 
-	if (acc[1] > 0 && value[2]) {
-		acc[1]--;
-		value[2] = false;
-		assert(value[3] == false);
-		value[3] = true;
+	trim();
+}
+
+Fibo &Fibo::operator-=(const Fibo &rhs) {
+	if (*this < rhs) {
+		throw std::underflow_error("Fibo subtraction underflow");
 	}
-	if (acc[2] > 0 && acc[1] > 0) {
-		acc[1]--;
-		acc[2]--;
-		assert(value[2] == false);
-		value[2] = true;
+	if (rhs.limbs.empty()) {
+		return *this;
 	}
-	if (acc[2] >= 2) {
-		acc[2] -= 2;
-		acc[1]++;
+
+	// Dopelnienie b na m fibitach a ma wartosc F(m + 3) - 2 - b, wiec a + dopelnienie + 2 = a - b + F(m + 3).
+	// Jest mniejsze od F(m + 4), wiec ma najwyzszy fibit m + 1, a ponizej niego postac a - b.
+	size_t m = length();
+	Fibo complement;
+	complement.limbs.resize(limbs.size());
+	for (size_t i = 0; i < limbs.size(); i++) {
+		complement.limbs[i] = ~(i < rhs.limbs.size() ? rhs.limbs[i] : 0);
 	}
-	if (acc[1] >= 2) {
-		acc[1] -= 2;
-		acc[2]++;
-		assert(value[2] == false);
-		value[2] = true;
+	if (m % LIMB_BITS != 0) {
+		complement.limbs.back() &= (limb(1) << (m % LIMB_BITS)) - 1;
 	}
+	// Przeniesienia przechodza przez runy jedynek dopelnienia po fibicie na krok, wiec najpierw je normujemy.
+	complement.normalize();
 
-	assert(acc[2] <= 1);
-	value[0] = acc[2];
+	*this += complement;
+	*this += Fibo(2);
+	set(m + 1, false);
+	trim();
+	return *this;
+}
 
-	assert(acc[1] <= 1);
-	value[1] = acc[1];
+Fibo &Fibo::operator*=(const Fibo &rhs) {
+	*this = from_natural(multiply(to_natural(), rhs.to_natural()));
+	return *this;
+}
 
-	normalize();
+Fibo &Fibo::operator/=(const Fibo &rhs) {
+	*this = divmod(*this, rhs).first;
 	return *this;
 }
 
-Fibo &Fibo::operator&=(const Fibo &rhs) {
-	value.resize(std::min(length(), rhs.length()));
-	for (size_t i = 0; i < length(); i++) {
-		value[i] = value[i] & rhs.value[i];
+Fibo &Fibo::operator%=(const Fibo &rhs) {
+	*this = divmod(*this, rhs).second;
+	return *this;
+}
+
+std::pair<Fibo, Fibo> divmod(const Fibo &dividend, const Fibo &divisor) {
+	if (divisor.limbs.empty()) {
+		throw std::domain_error("Fibo division by zero");
 	}
-	trim();
+	if (dividend < divisor) {
+		return {Zero(), dividend};
+	}
+	auto [quotient, remainder] = divide(dividend.to_natural(), divisor.to_natural());
+	return {Fibo::from_natural(quotient), Fibo::from_natural(remainder)};
+}
+
+Fibo pow(const Fibo &base, uint64_t exponent) {
+	natural value = base.to_natural();
+	natural power{1};
+	for (size_t bit = std::numeric_limits<uint64_t>::digits; bit-- > 0;) {
+		power = multiply(power, power);
+		if (((exponent >> bit) & 1) != 0) {
+			power = multiply(power, value);
+		}
+	}
+	return Fibo::from_natural(power);
+}
+
+Fibo &Fibo::operator&=(const Fibo &rhs) {
+	combine(rhs, std::bit_and<limb>());
 	// Nie potrzeba normalizacji.
 	return *this;
 }
 
 Fibo &Fibo::operator^=(const Fibo &rhs) {
-	upsize(rhs);
-	for (size_t i = 0; i < rhs.length(); i++) {
-		value[i] = value[i] ^ rhs.value[i];
-	}
+	combine(rhs, std::bit_xor<limb>());
 	normalize();
 	return *this;
 }
 
 Fibo &Fibo::operator|=(const Fibo &rhs) {
-	upsize(rhs);
-	for (size_t i = 0; i < rhs.length(); i++) {
-		value[i] = value[i] | rhs.value[i];
-	}
+	combine(rhs, std::bit_or<limb>());
 	normalize();
 	return *this;
 }
 
 Fibo &Fibo::operator<<=(const size_t n) {
-	value.resize(value.size() + n, false);
-	for (size_t i = value.size(); i-- > n;) {
-		value[i] = value[i - n];
+	if (limbs.empty()) {
+		return *this;
 	}
-	for (size_t i = n; i-- > 0;) {
-		value[i] = false;
+	size_t limbShift = n / LIMB_BITS;
+	size_t fibitShift = n % LIMB_BITS;
+	limbs.resize((length() + n + LIMB_BITS - 1) / LIMB_BITS, 0);
+	for (size_t i = limbs.size(); i-- > limbShift;) {
+		limbs[i] = limbs[i - limbShift] << fibitShift;
+		// Przesuniecie o LIMB_BITS nie jest okreslone.
+		if (fibitShift != 0 && i > limbShift) {
+			limbs[i] |= limbs[i - limbShift - 1] >> (LIMB_BITS - fibitShift);
+		}
 	}
+	std::fill(limbs.begin(), limbs.begin() + limbShift, 0);
 	trim();
+	// Przesuniecie zachowuje postac unormowana.
 	return *this;
 }
 
 [[nodiscard]] size_t Fibo::length() const {
-	return value.size();
+	if (limbs.empty()) {
+		return 1;
+	}
+	return limbs.size() * LIMB_BITS - __builtin_clzll(limbs.back());
 }
 
 std::ostream &operator<<(std::ostream &stream, const Fibo &lhs) {
-	for (auto it = lhs.value.rbegin(); it != lhs.value.rend(); it++) {
-		stream << *it;
+	for (size_t i = lhs.length(); i-- > 0;) {
+		stream << lhs[i];
 	}
 	return stream;
 }
 
+namespace {
+	// Inicjowane w czasie kompilacji, wiec gotowe przed inicjalizacja innych zmiennych statycznych.
+	const Fibo ZERO;
+	const Fibo ONE(1);
+}
+
 const Fibo &Zero() {
-	static const Fibo zero;
-	return zero;
+	return ZERO;
 }
 
 const Fibo &One() {
-	static const Fibo one(1);
-	return one;
+	return ONE;
 }
 
@@ -7,28 +7,162 @@
 #ifndef FIBO_H
 #define FIBO_H
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <ostream>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 #include <cassert>
 #include <boost/operators.hpp>
+#include "fibo_static.h"
+
+namespace fibo {
+	template<typename Expression>
+	class expression;
+
+	class batch;
+}
 
 /** @brief Class representing Fibo number.
  */
 class Fibo :
 		boost::addable<Fibo>,
+		boost::subtractable<Fibo>,
+		boost::multipliable<Fibo>,
+		boost::dividable<Fibo>,
+		boost::modable<Fibo>,
 		boost::bitwise<Fibo>,
 		boost::totally_ordered<Fibo>,
 		boost::left_shiftable<Fibo, size_t> {
 private:
+	/** @brief Word holding consecutive fibits, the lowest position in the lowest bit.
+	 */
+	using limb = uint64_t;
+
+	static constexpr size_t LIMB_BITS = std::numeric_limits<limb>::digits;
+
+	/** @brief Limbs held in the object, so values up to 128 fibits are not allocated.
+	 */
+	static constexpr size_t INLINE_LIMBS = 2;
+
+	/** @brief Vector of limbs keeping up to INLINE_LIMBS limbs in itself.
+	 * Moves to the heap when it grows above them and keeps the heap buffer
+	 * until destroyed or moved from.
+	 */
+	class limb_vector {
+	private:
+		limb *words;
+		size_t count;
+		size_t capacity;
+		limb inlineWords[INLINE_LIMBS];
+
+	public:
+		/** @brief Makes room for at least newCapacity limbs, keeping the contents.
+		 * @param[in] newCapacity   - number of limbs.
+		 */
+		void reserve(size_t newCapacity);
+
+		constexpr limb_vector() noexcept : words(inlineWords), count(0), capacity(INLINE_LIMBS), inlineWords{} {}
+
+		/** @brief Creates vector with copies of given limbs, at compile time if they fit in the object.
+		 * @param[in] first   - pointer to the first limb.
+		 * @param[in] size    - number of limbs.
+		 */
+		constexpr limb_vector(const limb *first, size_t size)
+				: words(inlineWords), count(0), capacity(INLINE_LIMBS), inlineWords{} {
+			if (size > INLINE_LIMBS) {
+				reserve(size);
+			}
+			for (size_t i = 0; i < size; i++) {
+				words[i] = first[i];
+			}
+			count = size;
+		}
+
+		limb_vector(const limb_vector &rhs);
+
+		limb_vector(limb_vector &&rhs) noexcept;
+
+		limb_vector &operator=(const limb_vector &rhs);
+
+		limb_vector &operator=(limb_vector &&rhs) noexcept;
+
+		~limb_vector();
+
+		[[nodiscard]] size_t size() const { return count; }
+
+		[[nodiscard]] bool empty() const { return count == 0; }
+
+		limb *data() { return words; }
+
+		[[nodiscard]] const limb *data() const { return words; }
+
+		limb *begin() { return words; }
+
+		limb *end() { return words + count; }
+
+		[[nodiscard]] const limb *begin() const { return words; }
+
+		[[nodiscard]] const limb *end() const { return words + count; }
+
+		limb &operator[](size_t index) { return words[index]; }
+
+		const limb &operator[](size_t index) const { return words[index]; }
+
+		limb &back() { return words[count - 1]; }
+
+		[[nodiscard]] const limb &back() const { return words[count - 1]; }
+
+		/** @brief Changes the number of limbs, new limbs are equal value.
+		 * @param[in] newSize   - number of limbs.
+		 * @param[in] value     - value of the added limbs.
+		 */
+		void resize(size_t newSize, limb value = 0);
+
+		void push_back(limb value);
+
+		void pop_back() { count--; }
+
+		bool operator==(const limb_vector &rhs) const;
+	};
+
 	/** @brief Represents Fibo value by normalized form.
+	 * Fibit at position pos is bit pos % LIMB_BITS of limbs[pos / LIMB_BITS].
+	 * There are no zero limbs on top, so value 0 has no limbs.
 	 */
-	std::vector<bool> value;
+	limb_vector limbs;
 
 	/** @brief Normalize Fibo value.
 	 */
 	void normalize();
 
+	/** @brief Replaces every run of fibits equal 1 with its normalized form.
+	 * Runs are rewritten 64 fibits at a time, but fibits of neighbouring runs
+	 * may form new pairs of adjacent ones.
+	 * @return Number of pairs of adjacent ones left within limbs.
+	 */
+	size_t normalize_runs();
+
+	/** @brief Adds value to current Fibo without normalizing the result.
+	 * Both values may be not normalized, but long runs of fibits equal 1
+	 * make the carries pass them a fibit at a time.
+	 * @param[in] rhs       - value to add represented by reference to Fibo.
+	 * @param[in] buffers   - scratch space of the carries, reused between calls.
+	 */
+	void accumulate(const Fibo &rhs, std::vector<limb> &buffers);
+
+	/** @brief Applies fibit operation to limbs of current Fibo and given Fibo.
+	 * Missing limbs of the shorter Fibo are zeros. The result is not normalized.
+	 * @param[in] rhs         - reference to Fibo.
+	 * @param[in] operation   - std::bit_and, std::bit_or or std::bit_xor of limbs.
+	 */
+	template<typename Operation>
+	void combine(const Fibo &rhs, Operation operation);
+
 	/** @brief Normalize two next positions of Fibo value.
 	 * Normalizes [pos] and [pos + 1]. Also normalizes any changes made on positions > pos.
 	 * Requirements: representation is normalized from [pos + 1] upwards.
@@ -36,31 +170,73 @@ private:
 	 */
 	void normalize(size_t pos);
 
-	/** @brief Removes all leading zeros.
+	/** @brief Removes all leading zero limbs.
 	 */
 	void trim();
 
-	/** @brief Resize current Fibo @p value vector by adding 'false'.
-	 * If current Fibo @p value vector is shorter than rhs Fibo value @p value
-	 * vector then add 'false' values to current Fibo @p value vector until
-	 * both @p value vectors have same size. Otherwise nothing happens.
+	/** @brief Resize current Fibo @p limbs vector by adding zero limbs.
+	 * If current Fibo @p limbs vector is shorter than rhs Fibo @p limbs
+	 * vector then add zero limbs to current Fibo @p limbs vector until
+	 * both @p limbs vectors have same size. Otherwise nothing happens.
 	 * @param[in] rhs   - reference to other Fibo.
 	 */
 	void upsize(const Fibo &rhs);
 
-	/** @brief Return value of given position in @p value vector.
-	 * If the given position is greater than @p value vector size then return
-	 * @p false.
+	/** @brief Return fibit at given position.
+	 * If the given position is not in @p limbs vector then return @p false.
 	 * @param[in] pos   - position represented by non-negative integer.
-	 * @return Value of position pos in @p value vector. If pos is greater than
-	 * @p value size then @p false.
+	 * @return Fibit at position pos. If pos is not in @p limbs then @p false.
 	 */
 	bool operator[](size_t pos) const;
 
+	/** @brief Sets fibit at given position.
+	 * Adds zero limbs if the given position is not in @p limbs vector.
+	 * @param[in] pos     - position represented by non-negative integer.
+	 * @param[in] fibit   - new fibit at position pos.
+	 */
+	void set(size_t pos, bool fibit);
+
+	/** @brief Returns pairs of adjacent fibits equal 1 starting in given limb.
+	 * Bit i of the result is set if fibits i and i + 1 of the limb are equal 1,
+	 * where fibit 64 is the lowest fibit of the next limb.
+	 * @param[in] index   - index of the limb in @p limbs vector.
+	 * @return Mask of the lower fibits of the pairs.
+	 */
+	limb adjacent(size_t index) const;
+
+	/** @brief Conversions between normalized form and binary natural numbers.
+	 * Binary form is the intermediate representation of multiplication and division.
+	 */
+	class converter;
+
+	/** @brief Returns Fibo value in binary.
+	 * @return Words of the value, the lowest first, without zero words on top.
+	 */
+	[[nodiscard]] std::vector<limb> to_natural() const;
+
+	/** @brief Creates Fibo with value given in binary.
+	 * @param[in] value   - words of the value, the lowest first, without zero words on top.
+	 * @return Fibo with given value.
+	 */
+	static Fibo from_natural(const std::vector<limb> &value);
+
+	/** @brief Returns value of Fibo of at most INLINE_LIMBS limbs in binary.
+	 * @return Value of Fibo, less than F(130).
+	 */
+	[[nodiscard]] unsigned __int128 small_value() const;
+
+	template<typename Expression>
+	friend class fibo::expression;
+
+	template<size_t N>
+	friend class StaticFibo;
+
+	friend class fibo::batch;
+
 public:
 	/** @brief Create new Fibo with initial value 0.
 	 */
-	Fibo();
+	constexpr Fibo() = default;
 
 	template<typename T, std::enable_if_t<
 			std::is_integral<T>::value
@@ -68,15 +244,47 @@ public:
 			&& !std::is_same<bool, T>::value, int> = 0>
 	/** @brief Fibo constructor creates new Fibo with given initial value.
 	 * Constructor is enabled only for integral types excluding char and bool.
+	 * Constructor is constexpr, so static Fibo with constant value is initialized
+	 * at compile time. Literals such as 25_fibo are computed at compile time everywhere.
 	 * @param[in] n   - initial Fibo value represented by non-negative integer.
 	 */
-	Fibo(T n);
+	constexpr Fibo(T n);
+
+	/** @brief Creates new Fibo with value of StaticFibo.
+	 * Values of at most INLINE_LIMBS limbs are created at compile time.
+	 * @param[in] value   - reference to StaticFibo.
+	 */
+	template<size_t N>
+	constexpr Fibo(const StaticFibo<N> &value);
 
 	/** @brief Creates new Fibo with given initial value.
 	 * @param[in] str   - initial Fibo value represented by description in fibonacci system.
 	 */
 	explicit Fibo(const std::string_view &str);
 
+	/** @brief Creates new Fibo with value given in decimal.
+	 * Conversion of n digits takes time close to that of multiplication of n digit numbers.
+	 * @param[in] str   - non-empty sequence of decimal digits.
+	 * @return Fibo with given value.
+	 */
+	static Fibo from_decimal(const std::string_view &str);
+
+	/** @brief Returns Fibo value in decimal.
+	 * @return Decimal digits of the value, without leading zeros.
+	 */
+	[[nodiscard]] std::string to_decimal() const;
+
+	/** @brief Creates new Fibo with value given in binary.
+	 * @param[in] str   - non-empty sequence of binary digits.
+	 * @return Fibo with given value.
+	 */
+	static Fibo from_binary(const std::string_view &str);
+
+	/** @brief Returns Fibo value in binary.
+	 * @return Binary digits of the value, without leading zeros.
+	 */
+	[[nodiscard]] std::string to_binary() const;
+
 	/** @brief Standard copy constructor.
 	 * @param[in] rhs   - Fibo to copy.
 	 */
@@ -120,6 +328,49 @@ public:
 	 */
 	Fibo &operator+=(const Fibo &rhs);
 
+	/** @brief Subtracts value from current Fibo.
+	 * @param[in] rhs   - value to subtract represented by reference to Fibo.
+	 * @return Reference to current Fibo with subtracted value.
+	 * @throws std::underflow_error if @p rhs is greater than current Fibo,
+	 * which is then left unchanged.
+	 */
+	Fibo &operator-=(const Fibo &rhs);
+
+	/** @brief Multiplies current Fibo by value.
+	 * @param[in] rhs   - multiplier represented by reference to Fibo.
+	 * @return Reference to current multiplied Fibo.
+	 */
+	Fibo &operator*=(const Fibo &rhs);
+
+	/** @brief Divides current Fibo by value, rounding down.
+	 * @param[in] rhs   - divisor represented by reference to Fibo.
+	 * @return Reference to current divided Fibo.
+	 * @throws std::domain_error if @p rhs is zero.
+	 */
+	Fibo &operator/=(const Fibo &rhs);
+
+	/** @brief Replaces current Fibo by remainder of its division by value.
+	 * @param[in] rhs   - divisor represented by reference to Fibo.
+	 * @return Reference to current changed Fibo.
+	 * @throws std::domain_error if @p rhs is zero.
+	 */
+	Fibo &operator%=(const Fibo &rhs);
+
+	/** @brief Divides Fibo by Fibo, rounding down.
+	 * @param[in] dividend   - reference to divided Fibo.
+	 * @param[in] divisor    - reference to divisor.
+	 * @return Quotient and remainder.
+	 * @throws std::domain_error if @p divisor is zero.
+	 */
+	friend std::pair<Fibo, Fibo> divmod(const Fibo &dividend, const Fibo &divisor);
+
+	/** @brief Raises Fibo to given power, pow(0, 0) is 1.
+	 * @param[in] base       - reference to Fibo.
+	 * @param[in] exponent   - non-negative integer exponent.
+	 * @return Fibo equal @p base to the power of @p exponent.
+	 */
+	friend Fibo pow(const Fibo &base, uint64_t exponent);
+
 	/** @brief Changes current Fibo by making 'and' operation
 	 * on every fibit at normalized form with given Fibo.
 	 * @param[in] rhs   - reference to Fibo.
@@ -164,29 +415,35 @@ template<typename T, std::enable_if_t<
 		std::is_integral<T>::value
 		&& !std::is_same<char, T>::value
 		&& !std::is_same<bool, T>::value, int>>
-Fibo::Fibo(T n) {
-	assert(n >= 0);
-	T f1 = 1;
-	T f2 = 1;
-	size_t pos = 0;
-	while (n >= f2 && n - f2 >= f1) {
-		pos++;
-		T tmp = f2;
-		f2 = f2 + f1;
-		f1 = tmp;
+constexpr Fibo::Fibo(T n) : Fibo(StaticFibo<std::numeric_limits<T>::digits * 3 / 2 + 2>(n)) {
+	// F(n + 2) > 1.5^n, wiec liczba o k bitach ma mniej niz 1.5 k fibitow.
+}
+
+template<size_t N>
+constexpr Fibo::Fibo(const StaticFibo<N> &value) : limbs(value.limbs, value.size()) {}
+
+template<size_t N>
+StaticFibo<N>::StaticFibo(const Fibo &value) : limbs{} {
+	if (value.length() > N && !value.limbs.empty()) {
+		throw std::overflow_error("StaticFibo overflow");
 	}
-	value.resize(pos + 1);
-	while (n > 0) {
-		if (n >= f2) {
-			value[pos] = true;
-			n -= f2;
-		}
-		pos--;
-		T tmp = f1;
-		f1 = f2 - f1;
-		f2 = tmp;
+	for (size_t i = 0; i < value.limbs.size(); i++) {
+		limbs[i] = value.limbs[i];
+	}
+}
+
+template<typename Operation>
+void Fibo::combine(const Fibo &rhs, Operation operation) {
+	// Brakujace limby sa zerami, wiec and konczy sie na krotszym z wektorow.
+	if (std::is_same<Operation, std::bit_and<limb>>::value) {
+		limbs.resize(std::min(limbs.size(), rhs.limbs.size()));
+	} else {
+		upsize(rhs);
+	}
+	for (size_t i = 0; i < std::min(limbs.size(), rhs.limbs.size()); i++) {
+		limbs[i] = operation(limbs[i], rhs.limbs[i]);
 	}
-	// Nie trzeba normalizowaÄ.
+	trim();
 }
 
 /** @brief Creates static Fibo with value 0.
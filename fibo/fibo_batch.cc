@@ -0,0 +1,231 @@
+/** @file
+ * @brief Bulk operations on arrays of Fibo numbers implementation.
+ * @authors Piotr Jasinski and Antoni Zewierzejew
+ */
+
+#include "fibo_batch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using std::vector;
+
+namespace fibo {
+	/** @brief Access of bulk operations to the representation of Fibo.
+	 */
+	class batch {
+	public:
+		/** @brief Key ordered as Fibo numbers, except keys of equal numbers longer than a limb.
+		 * Fibits [length - 64, length) of normalized form, shorter numbers whole.
+		 */
+		struct key {
+			uint64_t length;
+			uint64_t top;
+			size_t index;
+		};
+
+		static key sort_key(const Fibo &value, size_t index) {
+			const Fibo::limb_vector &limbs = value.limbs;
+			size_t length = value.length();
+			if (limbs.size() <= 1) {
+				return {length, limbs.empty() ? 0 : limbs[0], index};
+			}
+			size_t shift = length % Fibo::LIMB_BITS;
+			uint64_t top = limbs.back();
+			// Przesuniecie o LIMB_BITS nie jest okreslone.
+			if (shift != 0) {
+				top = (top << (Fibo::LIMB_BITS - shift)) | (limbs[limbs.size() - 2] >> shift);
+			}
+			return {length, top, index};
+		}
+
+		static bool whole(const key &value) {
+			return value.length <= Fibo::LIMB_BITS;
+		}
+
+		static bool small(const Fibo &value) {
+			return value.limbs.size() <= Fibo::INLINE_LIMBS;
+		}
+
+		static unsigned __int128 small_value(const Fibo &value) {
+			return value.small_value();
+		}
+
+		static Fibo from_natural(const vector<uint64_t> &value) {
+			return Fibo::from_natural(value);
+		}
+
+		static void add(Fibo &result, const Fibo &term, vector<uint64_t> &buffers) {
+			result.accumulate(term, buffers);
+			result.normalize();
+		}
+
+		static void combine_or(Fibo &result, const Fibo &term) {
+			result.combine(term, std::bit_or<uint64_t>());
+		}
+
+		static void normalize(Fibo &value) {
+			value.normalize();
+		}
+	};
+}
+
+using fibo::batch;
+
+namespace {
+	/** @brief Threads are not started for fewer values than this.
+	 */
+	constexpr size_t VALUES_PER_THREAD = 1 << 12;
+
+	/** @brief Returns number of threads for given number of values.
+	 * @param[in] values    - number of values.
+	 * @param[in] threads   - maximal number of threads, 0 for the number of processors.
+	 * @return Number of threads, at least 1.
+	 */
+	size_t thread_count(size_t values, size_t threads) {
+		if (threads == 0) {
+			threads = std::thread::hardware_concurrency();
+		}
+		return std::max<size_t>(std::min(threads, (values + VALUES_PER_THREAD - 1) / VALUES_PER_THREAD), 1);
+	}
+
+	/** @brief Returns first value of given chunk of values split evenly.
+	 * @param[in] chunk    - index of the chunk, chunks for the end.
+	 * @param[in] chunks   - number of chunks.
+	 * @param[in] values   - number of values.
+	 * @return Index of the first value.
+	 */
+	size_t chunk_begin(size_t chunk, size_t chunks, size_t values) {
+		return chunk * values / chunks;
+	}
+
+	/** @brief Runs task(0), ..., task(count - 1), each on its own thread.
+	 * task(0) runs on the calling thread. Exceptions of the tasks are rethrown.
+	 * @param[in] count   - number of tasks.
+	 * @param[in] task    - function of the index of the task.
+	 */
+	template<typename Task>
+	void parallel(size_t count, const Task &task) {
+		vector<std::future<void>> tasks;
+		for (size_t index = 1; index < count; index++) {
+			tasks.push_back(std::async(std::launch::async, task, index));
+		}
+		task(0);
+		for (std::future<void> &other : tasks) {
+			other.get();
+		}
+	}
+
+	/** @brief Combines partial results pairwise, level by level.
+	 * @param[in,out] partials   - partial results, the result is left in the first.
+	 * @param[in] combine        - function combining its second argument into the first.
+	 */
+	template<typename Combine>
+	void reduce(vector<Fibo> &partials, const Combine &combine) {
+		for (size_t stride = 1; stride < partials.size(); stride *= 2) {
+			// Pary (0, stride), (2 stride, 3 stride), ...
+			size_t pairs = (partials.size() - stride + 2 * stride - 1) / (2 * stride);
+			parallel(pairs, [&](size_t pair) {
+				combine(partials[2 * stride * pair], partials[2 * stride * pair + stride]);
+			});
+		}
+	}
+}
+
+Fibo fibo::sum(const Fibo *first, const Fibo *last, size_t threads) {
+	size_t values = last - first;
+	vector<Fibo> partials(thread_count(values, threads));
+	// Male liczby sumujemy binarnie: zamiana na liczbe binarna jest tansza niz dodawanie Fibo.
+	parallel(partials.size(), [&](size_t chunk) {
+		vector<uint64_t> buffers;
+		unsigned __int128 smallSum = 0;
+		uint64_t overflows = 0;
+		for (size_t i = chunk_begin(chunk, partials.size(), values);
+		     i < chunk_begin(chunk + 1, partials.size(), values); i++) {
+			if (batch::small(first[i])) {
+				unsigned __int128 value = batch::small_value(first[i]);
+				smallSum += value;
+				overflows += smallSum < value;
+			} else {
+				batch::add(partials[chunk], first[i], buffers);
+			}
+		}
+		vector<uint64_t> words = {uint64_t(smallSum), uint64_t(smallSum >> 64), overflows};
+		while (!words.empty() && words.back() == 0) {
+			words.pop_back();
+		}
+		batch::add(partials[chunk], batch::from_natural(words), buffers);
+	});
+	reduce(partials, [](Fibo &lhs, const Fibo &rhs) {
+		lhs += rhs;
+	});
+	return std::move(partials[0]);
+}
+
+Fibo fibo::or_fibits(const Fibo *first, const Fibo *last, size_t threads) {
+	size_t values = last - first;
+	vector<Fibo> partials(thread_count(values, threads));
+	// 'Or' postaci unormowanych jest laczne, dopoki wynik nie jest normowany.
+	parallel(partials.size(), [&](size_t chunk) {
+		for (size_t i = chunk_begin(chunk, partials.size(), values);
+		     i < chunk_begin(chunk + 1, partials.size(), values); i++) {
+			batch::combine_or(partials[chunk], first[i]);
+		}
+	});
+	reduce(partials, [](Fibo &lhs, const Fibo &rhs) {
+		batch::combine_or(lhs, rhs);
+	});
+	batch::normalize(partials[0]);
+	return std::move(partials[0]);
+}
+
+void fibo::sort(Fibo *first, Fibo *last, size_t threads) {
+	size_t values = last - first;
+	size_t chunks = thread_count(values, threads);
+	vector<batch::key> keys(values);
+	auto less = [first](const batch::key &lhs, const batch::key &rhs) {
+		if (lhs.length != rhs.length) {
+			return lhs.length < rhs.length;
+		}
+		if (lhs.top != rhs.top) {
+			return lhs.top < rhs.top;
+		}
+		return !batch::whole(lhs) && first[lhs.index] < first[rhs.index];
+	};
+
+	parallel(chunks, [&](size_t chunk) {
+		size_t begin = chunk_begin(chunk, chunks, values);
+		size_t end = chunk_begin(chunk + 1, chunks, values);
+		for (size_t i = begin; i < end; i++) {
+			keys[i] = batch::sort_key(first[i], i);
+		}
+		std::sort(keys.begin() + begin, keys.begin() + end, less);
+	});
+	for (size_t stride = 1; stride < chunks; stride *= 2) {
+		size_t pairs = (chunks - stride + 2 * stride - 1) / (2 * stride);
+		parallel(pairs, [&](size_t pair) {
+			size_t chunk = 2 * stride * pair;
+			std::inplace_merge(keys.begin() + chunk_begin(chunk, chunks, values),
+			                   keys.begin() + chunk_begin(chunk + stride, chunks, values),
+			                   keys.begin() + chunk_begin(std::min(chunk + 2 * stride, chunks), chunks, values), less);
+		});
+	}
+
+	// Przenoszenie Fibo przenosi tylko wskaznik na limby albo limby trzymane w obiekcie.
+	vector<Fibo> sorted(values);
+	parallel(chunks, [&](size_t chunk) {
+		for (size_t i = chunk_begin(chunk, chunks, values); i < chunk_begin(chunk + 1, chunks, values); i++) {
+			sorted[i] = std::move(first[keys[i].index]);
+		}
+	});
+	parallel(chunks, [&](size_t chunk) {
+		for (size_t i = chunk_begin(chunk, chunks, values); i < chunk_begin(chunk + 1, chunks, values); i++) {
+			first[i] = std::move(sorted[i]);
+		}
+	});
+}
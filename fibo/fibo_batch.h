@@ -0,0 +1,45 @@
+/** @file
+ * @brief Bulk operations on arrays of Fibo numbers.
+ * @authors Piotr Jasinski and Antoni Zewierzejew
+ *
+ * Arrays are split into chunks processed by separate threads, whose results
+ * are combined by a tree reduction. Build with -pthread.
+ */
+#ifndef FIBO_BATCH_H
+#define FIBO_BATCH_H
+
+#include <cstddef>
+#include "fibo.h"
+
+namespace fibo {
+	/** @brief Adds Fibo numbers.
+	 * @param[in] first     - pointer to the first Fibo.
+	 * @param[in] last      - pointer past the last Fibo.
+	 * @param[in] threads   - maximal number of threads, 0 for the number of processors.
+	 * @return Sum of all Fibo numbers, 0 for an empty array.
+	 */
+	Fibo sum(const Fibo *first, const Fibo *last, size_t threads = 0);
+
+	/** @brief Not a fold of operator|: normalizes 'or' of fibits of all Fibo numbers once.
+	 * a | b | c normalizes a | b before 'or' with c, which may give a different
+	 * number, and 'or' of normalized forms is not associative, so it has no
+	 * parallel form. Here fibits at normalized forms of all values are combined
+	 * first, which does not depend on the order, and the result is normalized.
+	 * @param[in] first     - pointer to the first Fibo.
+	 * @param[in] last      - pointer past the last Fibo.
+	 * @param[in] threads   - maximal number of threads, 0 for the number of processors.
+	 * @return Fibo with normalized 'or' of fibits of all Fibo numbers, 0 for an empty array.
+	 */
+	Fibo or_fibits(const Fibo *first, const Fibo *last, size_t threads = 0);
+
+	/** @brief Sorts Fibo numbers in ascending order.
+	 * Compares keys made of the length and the highest limb of normalized forms,
+	 * Fibo numbers are compared only when their keys are equal.
+	 * @param[in,out] first   - pointer to the first Fibo.
+	 * @param[in,out] last    - pointer past the last Fibo.
+	 * @param[in] threads     - maximal number of threads, 0 for the number of processors.
+	 */
+	void sort(Fibo *first, Fibo *last, size_t threads = 0);
+}
+
+#endif /* FIBO_BATCH_H */
@@ -0,0 +1,366 @@
+/** @file
+ * @brief Benchmarks of Fibo numbers.
+ * @authors Piotr Jasinski and Antoni Zewierzejew
+ *
+ * Results are written to the standard output as JSON in the format of Google
+ * Benchmark, so that its tools can compare runs, e.g. of builds of two revisions.
+ *
+ * Build: g++ -std=c++17 -O2 -DNDEBUG -pthread fibo.cc fibo_batch.cc fibo_benchmark.cc -o fibo_benchmark
+ * Usage: fibo_benchmark [--min-time SECONDS] [--filter TEXT]
+ *
+ * Operands have 1000, 64000 and 1000000 fibits, expression chains 40, 120 and
+ * 1000 fibits. The addition kernel is chosen with FIBO_ADD_KERNEL (scalar or
+ * avx2), which is recorded in the context. Heap allocations are counted by the
+ * replaced operator new and reported per iteration. Benchmarks with the _lazy
+ * suffix evaluate the same expressions with fibo::lazy, from_literal creates
+ * Fibo from a StaticFibo literal computed at compile time. Batch operations run
+ * on 2^20 random 64-bit values with 1, 2, 4, ... threads up to the number of
+ * processors, batch_sort and std_sort include the copy measured by batch_copy.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "fibo.h"
+#include "fibo_batch.h"
+#include "fibo_expression.h"
+
+namespace {
+	std::atomic<size_t> allocations(0);
+}
+
+void *operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+	std::free(memory);
+}
+
+namespace {
+	struct options {
+		double minTime = 0.2;
+		std::string filter;
+	};
+
+	struct result {
+		std::string name;
+		size_t iterations;
+		double realTime;
+		double cpuTime;
+		double allocations;
+	};
+
+	options benchmarkOptions;
+	std::vector<result> results;
+
+	const size_t SIZES[] = {1000, 64000, 1000000};
+
+	const size_t CHAIN_SIZES[] = {40, 120, 1000};
+
+	const size_t BATCH_SIZE = size_t(1) << 20;
+
+	bool selected(const std::string &benchmarkName) {
+		return benchmarkName.find(benchmarkOptions.filter) != std::string::npos;
+	}
+
+	/** @brief Random Fibo of about the given number of fibits.
+	 */
+	Fibo random_fibo(size_t fibits, unsigned seed) {
+		std::mt19937 generator(seed);
+		std::string description(fibits, '0');
+		description[0] = '1';
+		for (size_t fibit = 1; fibit < fibits; fibit++) {
+			description[fibit] = generator() % 2 == 0 ? '0' : '1';
+		}
+		return Fibo(description);
+	}
+
+	/** @brief Fibo 1010...10 of the given number of fibits, the densest normalized one.
+	 */
+	Fibo alternating_fibo(size_t fibits) {
+		std::string description(fibits, '0');
+		for (size_t fibit = 0; fibit < fibits; fibit += 2) {
+			description[fibit] = '1';
+		}
+		return Fibo(description);
+	}
+
+	double seconds_since(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void report(const std::string &benchmarkName, size_t iterations, double realSeconds, double cpuSeconds,
+	            size_t allocationCount) {
+		results.push_back({benchmarkName, iterations, realSeconds * 1e9 / double(iterations),
+		                   cpuSeconds * 1e9 / double(iterations), double(allocationCount) / double(iterations)});
+		std::cerr << benchmarkName << ": " << results.back().realTime << " ns, "
+		          << results.back().allocations << " allocations" << std::endl;
+	}
+
+	/** @brief Runs body until it took at least --min-time in total and reports its time per call.
+	 */
+	template<typename Body>
+	void run(const std::string &benchmarkName, Body body) {
+		if (!selected(benchmarkName)) {
+			return;
+		}
+
+		double realSeconds = 0, cpuSeconds = 0;
+		size_t iterations = 0;
+		size_t allocationCount = 0;
+
+		do {
+			std::clock_t cpuStart = std::clock();
+			size_t allocationStart = allocations.load(std::memory_order_relaxed);
+			auto start = std::chrono::steady_clock::now();
+			body();
+			realSeconds += seconds_since(start);
+			allocationCount += allocations.load(std::memory_order_relaxed) - allocationStart;
+			cpuSeconds += double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+			iterations++;
+		} while (realSeconds < benchmarkOptions.minTime);
+
+		report(benchmarkName, iterations, realSeconds, cpuSeconds, allocationCount);
+	}
+
+	/** @brief Benchmarks a + b, the copy of a included.
+	 */
+	void benchmark_add(const std::string &shape, const Fibo &lhs, const Fibo &rhs, size_t size) {
+		run("add_" + shape + "/" + std::to_string(size), [&] {
+			Fibo sum = lhs;
+			sum += rhs;
+		});
+	}
+
+	/** @brief Benchmarks a | b, the copy of a included, which normalizes the result.
+	 */
+	void benchmark_or(const Fibo &lhs, const Fibo &rhs, size_t size) {
+		run("or_random/" + std::to_string(size), [&] {
+			Fibo result = lhs;
+			result |= rhs;
+		});
+	}
+
+	/** @brief Benchmarks a + b + c + d, eagerly and lazily.
+	 */
+	void benchmark_sums(const Fibo &lhs, const Fibo &rhs, size_t size) {
+		Fibo third = random_fibo(size, 7);
+		Fibo fourth = random_fibo(size, 8);
+		run("sum4/" + std::to_string(size), [&] {
+			Fibo sum = lhs + rhs + third + fourth;
+		});
+		run("sum4_lazy/" + std::to_string(size), [&] {
+			Fibo sum = fibo::lazy(lhs) + rhs + third + fourth;
+		});
+	}
+
+	/** @brief Benchmarks a - b, a * b and a / c, with c of half the fibits of a.
+	 */
+	void benchmark_arithmetic(const Fibo &lhs, const Fibo &rhs, const Fibo &divisor, size_t size) {
+		const Fibo &larger = std::max(lhs, rhs);
+		const Fibo &smaller = std::min(lhs, rhs);
+		run("sub_random/" + std::to_string(size), [&] {
+			Fibo difference = larger;
+			difference -= smaller;
+		});
+		run("mul_random/" + std::to_string(size), [&] {
+			Fibo product = lhs * rhs;
+		});
+		run("div_random/" + std::to_string(size), [&] {
+			Fibo quotient = lhs / divisor;
+		});
+	}
+
+	/** @brief Benchmarks conversions of a to decimal and back.
+	 */
+	void benchmark_decimal(const Fibo &value, size_t size) {
+		run("to_decimal/" + std::to_string(size), [&] {
+			std::string digits = value.to_decimal();
+		});
+		if (selected("from_decimal/" + std::to_string(size))) {
+			std::string digits = value.to_decimal();
+			run("from_decimal/" + std::to_string(size), [&] {
+				Fibo parsed = Fibo::from_decimal(digits);
+			});
+		}
+	}
+
+	/** @brief Benchmarks a chain of sums, bitwise operations and a comparison on small values.
+	 */
+	void benchmark_chain(size_t size) {
+		Fibo a = random_fibo(size, 4);
+		Fibo b = random_fibo(size, 5);
+		Fibo c = random_fibo(size, 6);
+		run("chain/" + std::to_string(size), [&] {
+			Fibo result = (a + b + One()) ^ (c << 2);
+			result |= a & b;
+			if (result < a + c) {
+				result += Zero();
+			}
+		});
+		run("chain_lazy/" + std::to_string(size), [&] {
+			Fibo result = ((fibo::lazy(a) + b + One()) ^ (fibo::lazy(c) << 2)) | (fibo::lazy(a) & b);
+			if (result < fibo::lazy(a) + c) {
+				result += Zero();
+			}
+		});
+	}
+
+	/** @brief Benchmarks Fibo of a 64-bit integer, computed at run time and at compile time.
+	 */
+	void benchmark_integers() {
+		using namespace fibo::literals;
+		std::mt19937_64 generator(9);
+		run("from_integer", [&] {
+			Fibo value(generator());
+		});
+		run("from_literal", [&] {
+			Fibo value = 12200160415121876738_fibo;
+		});
+	}
+
+	/** @brief Benchmarks sum, 'or' and sorting of BATCH_SIZE values with growing number of threads.
+	 */
+	void benchmark_batch() {
+		size_t processors = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		std::vector<size_t> threadCounts;
+		for (size_t threads = 1; threads < processors; threads *= 2) {
+			threadCounts.push_back(threads);
+		}
+		threadCounts.push_back(processors);
+
+		std::vector<std::string> names = {"batch_copy", "std_sort"};
+		for (size_t threads : threadCounts) {
+			for (const char *operation : {"batch_sum", "batch_or_fibits", "batch_sort"}) {
+				names.push_back(operation + std::string("/threads:") + std::to_string(threads));
+			}
+		}
+		if (std::none_of(names.begin(), names.end(), selected)) {
+			return;
+		}
+
+		std::mt19937_64 generator(10);
+		std::vector<Fibo> values;
+		values.reserve(BATCH_SIZE);
+		for (size_t i = 0; i < BATCH_SIZE; i++) {
+			values.emplace_back(generator());
+		}
+		const Fibo *first = values.data();
+		const Fibo *last = first + values.size();
+
+		run("batch_copy", [&] {
+			std::vector<Fibo> copy = values;
+		});
+		run("std_sort", [&] {
+			std::vector<Fibo> copy = values;
+			std::sort(copy.begin(), copy.end());
+		});
+		for (size_t threads : threadCounts) {
+			std::string suffix = "/threads:" + std::to_string(threads);
+			run("batch_sum" + suffix, [&] {
+				Fibo sum = fibo::sum(first, last, threads);
+			});
+			run("batch_or_fibits" + suffix, [&] {
+				Fibo result = fibo::or_fibits(first, last, threads);
+			});
+			run("batch_sort" + suffix, [&] {
+				std::vector<Fibo> copy = values;
+				fibo::sort(copy.data(), copy.data() + copy.size(), threads);
+			});
+		}
+	}
+
+	void print_json() {
+		char const *kernel = std::getenv("FIBO_ADD_KERNEL");
+
+		std::cout << "{\n  \"context\": {\n"
+		          << "    \"executable\": \"fibo_benchmark\",\n"
+		          << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+		          << "    \"add_kernel\": \"" << (kernel == nullptr ? "auto" : kernel) << "\"\n"
+		          << "  },\n  \"benchmarks\": [";
+
+		for (size_t index = 0; index < results.size(); index++) {
+			const result &benchmark = results[index];
+			std::cout << (index == 0 ? "\n" : ",\n")
+			          << "    {\n"
+			          << "      \"name\": \"" << benchmark.name << "\",\n"
+			          << "      \"run_name\": \"" << benchmark.name << "\",\n"
+			          << "      \"run_type\": \"iteration\",\n"
+			          << "      \"iterations\": " << benchmark.iterations << ",\n"
+			          << "      \"real_time\": " << benchmark.realTime << ",\n"
+			          << "      \"cpu_time\": " << benchmark.cpuTime << ",\n"
+			          << "      \"time_unit\": \"ns\",\n"
+			          << "      \"allocations_per_iteration\": " << benchmark.allocations << ",\n"
+			          << "      \"items_per_second\": " << 1e9 / benchmark.realTime << "\n"
+			          << "    }";
+		}
+
+		std::cout << "\n  ]\n}" << std::endl;
+	}
+
+	bool parse_options(int argc, char *argv[]) {
+		for (int argument = 1; argument + 1 < argc; argument += 2) {
+			std::string option = argv[argument];
+			char const *value = argv[argument + 1];
+
+			if (option == "--min-time") {
+				benchmarkOptions.minTime = std::strtod(value, nullptr);
+			} else if (option == "--filter") {
+				benchmarkOptions.filter = value;
+			} else {
+				return false;
+			}
+		}
+
+		return argc % 2 == 1;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if (!parse_options(argc, argv)) {
+		std::cerr << "Usage: " << argv[0] << " [--min-time SECONDS] [--filter TEXT]" << std::endl;
+		return 1;
+	}
+
+	for (size_t size : SIZES) {
+		Fibo lhs = random_fibo(size, 1);
+		Fibo rhs = random_fibo(size, 2);
+		Fibo alternating = alternating_fibo(size);
+
+		benchmark_add("random", lhs, rhs, size);
+		benchmark_add("alternating", alternating, alternating, size);
+		benchmark_add("one", alternating, One(), size);
+		benchmark_or(lhs, rhs, size);
+		benchmark_sums(lhs, rhs, size);
+		benchmark_arithmetic(lhs, rhs, random_fibo(size / 2, 3), size);
+		benchmark_decimal(lhs, size);
+	}
+
+	for (size_t size : CHAIN_SIZES) {
+		benchmark_chain(size);
+	}
+
+	benchmark_integers();
+	benchmark_batch();
+
+	print_json();
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+/** @file
+ * @brief Fuzz test of normalization of Fibo numbers.
+ * @authors Piotr Jasinski and Antoni Zewierzejew
+ *
+ * Compares normalized forms computed by Fibo, a limb at a time, with the
+ * previous normalizer, which rewrites the highest pair of ones fibit by fibit.
+ * Inputs are random fibit strings: uniform and dense ones, long runs of ones,
+ * 1010...11 chains and runs placed across limb boundaries. They are normalized
+ * by the constructor of Fibo and by 'or' and 'xor' of normalized numbers.
+ * Reports the first mismatch and exits with status 1.
+ *
+ * Build: g++ -std=c++17 -O2 fibo.cc fibo_normalize_fuzz.cc -o fibo_normalize_fuzz
+ * Usage: fibo_normalize_fuzz [--iterations N] [--seed N]
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "fibo.h"
+
+namespace {
+	struct options {
+		size_t iterations = 100000;
+		unsigned seed = 1;
+	};
+
+	const size_t LIMB_BITS = 64;
+
+	const size_t MAX_FIBITS = 12 * LIMB_BITS;
+
+	/** @brief Fibits of a number, the lowest first.
+	 */
+	using fibits = std::vector<bool>;
+
+	/** @brief Normalizes fibits as Fibo did before it worked a limb at a time.
+	 * From the top, always the highest pair of ones: above it the form is already normalized.
+	 * @param[in,out] value   - fibits to normalize.
+	 */
+	void reference_normalize(fibits &value) {
+		value.resize(value.size() + 2, false);
+		for (size_t i = value.size() - 1; i-- > 0;) {
+			while (value[i] && value[i + 1]) {
+				// Od pary w gore przez lancuch 1010...11.
+				for (size_t pos = i; value[pos] && value[pos + 1]; pos += 2) {
+					value[pos] = false;
+					value[pos + 1] = false;
+					if (pos + 2 == value.size()) {
+						value.push_back(false);
+					}
+					value[pos + 2] = true;
+					if (pos + 3 == value.size()) {
+						value.push_back(false);
+					}
+				}
+			}
+		}
+	}
+
+	fibits from_string(const std::string &description) {
+		fibits value;
+		for (auto it = description.crbegin(); it != description.crend(); it++) {
+			value.push_back(*it == '1');
+		}
+		return value;
+	}
+
+	std::string to_string(const fibits &value) {
+		std::string description;
+		for (size_t i = value.size(); i-- > 0;) {
+			if (value[i] || !description.empty()) {
+				description.push_back(value[i] ? '1' : '0');
+			}
+		}
+		return description.empty() ? "0" : description;
+	}
+
+	std::string to_string(const Fibo &value) {
+		std::ostringstream stream;
+		stream << value;
+		return stream.str();
+	}
+
+	/** @brief Random fibit string with the highest fibit set.
+	 */
+	std::string random_description(std::mt19937_64 &generator) {
+		size_t length = 1 + generator() % MAX_FIBITS;
+		std::string description(length, '0');
+		switch (generator() % 5) {
+			case 0: // Jednostajnie.
+				for (char &fibit : description) {
+					fibit = generator() % 2 == 0 ? '0' : '1';
+				}
+				break;
+			case 1: // Gesto.
+				for (char &fibit : description) {
+					fibit = generator() % 8 == 0 ? '0' : '1';
+				}
+				break;
+			case 2: // Dlugie runy jedynek oddzielone zerami.
+				for (size_t pos = 0; pos < length;) {
+					size_t run = 1 + generator() % (3 * LIMB_BITS);
+					std::fill_n(description.begin() + pos, std::min(run, length - pos), '1');
+					pos += run + 1 + generator() % 3;
+				}
+				break;
+			case 3: // Lancuchy 1010...11.
+				for (size_t pos = 0; pos + 1 < length;) {
+					size_t chain = 1 + generator() % (2 * LIMB_BITS);
+					for (size_t i = 0; i < chain && pos + 1 < length; i++, pos += 2) {
+						description[pos] = '1';
+					}
+					description[pos - 1] = '1';
+					pos += generator() % 4;
+				}
+				break;
+			default: // Runy na granicach limbow.
+				for (size_t boundary = LIMB_BITS; boundary < length + LIMB_BITS; boundary += LIMB_BITS) {
+					size_t below = generator() % 8, above = generator() % 8;
+					for (size_t pos = boundary - std::min(below, boundary); pos < std::min(boundary + above, length); pos++) {
+						description[length - 1 - pos] = '1';
+					}
+				}
+				break;
+		}
+		description[0] = '1';
+		return description;
+	}
+
+	/** @brief Fibits of 'or' or 'xor' of fibits of two normalized numbers.
+	 */
+	fibits combine(const std::string &lhs, const std::string &rhs, bool exclusive) {
+		fibits left = from_string(lhs), right = from_string(rhs);
+		left.resize(std::max(left.size(), right.size()), false);
+		for (size_t i = 0; i < right.size(); i++) {
+			left[i] = exclusive ? left[i] != right[i] : left[i] || right[i];
+		}
+		return left;
+	}
+
+	bool check(const std::string &operation, const std::string &input, const Fibo &value, fibits expected) {
+		reference_normalize(expected);
+		if (to_string(value) == to_string(expected)) {
+			return true;
+		}
+		std::cerr << "Mismatch of " << operation << " of " << input << std::endl
+		          << "Fibo:      " << to_string(value) << std::endl
+		          << "reference: " << to_string(expected) << std::endl;
+		return false;
+	}
+
+	bool parse_options(int argc, char *argv[], options &fuzzOptions) {
+		for (int argument = 1; argument < argc; argument += 2) {
+			std::string option = argv[argument];
+			if (argument + 1 == argc) {
+				return false;
+			}
+			if (option == "--iterations") {
+				fuzzOptions.iterations = std::strtoull(argv[argument + 1], nullptr, 10);
+			} else if (option == "--seed") {
+				fuzzOptions.seed = unsigned(std::strtoul(argv[argument + 1], nullptr, 10));
+			} else {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	options fuzzOptions;
+	if (!parse_options(argc, argv, fuzzOptions)) {
+		std::cerr << "Usage: " << argv[0] << " [--iterations N] [--seed N]" << std::endl;
+		return 2;
+	}
+
+	std::mt19937_64 generator(fuzzOptions.seed);
+	for (size_t iteration = 0; iteration < fuzzOptions.iterations; iteration++) {
+		std::string lhs = random_description(generator), rhs = random_description(generator);
+		Fibo left(lhs), right(rhs);
+		if (!check("Fibo", lhs, left, from_string(lhs))) {
+			return 1;
+		}
+
+		std::string normalizedLeft = to_string(left), normalizedRight = to_string(right);
+		if (!check("|", normalizedLeft + " | " + normalizedRight, left | right,
+		           combine(normalizedLeft, normalizedRight, false))
+		    || !check("^", normalizedLeft + " ^ " + normalizedRight, left ^ right,
+		              combine(normalizedLeft, normalizedRight, true))) {
+			return 1;
+		}
+	}
+
+	std::cout << fuzzOptions.iterations << " inputs match" << std::endl;
+	return 0;
+}
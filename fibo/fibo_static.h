@@ -0,0 +1,448 @@
+/** @file
+ * @brief Fibo numbers of fixed width, usable at compile time.
+ * @authors Piotr Jasinski and Antoni Zewierzejew
+ *
+ * StaticFibo<N> holds values with normalized form of at most N fibits in an
+ * array, so it can be constructed and added in constant expressions, e.g.
+ * constexpr StaticFibo<16> x = StaticFibo<16>(100) + 25_fibo. Results longer
+ * than N fibits throw std::overflow_error, which at compile time is an error.
+ * StaticFibo converts implicitly to wider StaticFibo and to Fibo, Fibo and
+ * wider StaticFibo convert to it explicitly.
+ */
+#ifndef FIBO_STATIC_H
+#define FIBO_STATIC_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+class Fibo;
+
+/** @brief Class representing Fibo number of at most N fibits.
+ * @tparam N   - maximal length of normalized form.
+ */
+template<size_t N>
+class StaticFibo {
+	static_assert(N > 0, "StaticFibo needs at least one fibit");
+
+private:
+	/** @brief Word holding consecutive fibits, the lowest position in the lowest bit.
+	 */
+	using limb = uint64_t;
+
+	static constexpr size_t LIMB_BITS = std::numeric_limits<limb>::digits;
+
+	static constexpr size_t LIMBS = (N + LIMB_BITS - 1) / LIMB_BITS;
+
+	/** @brief Limbs of intermediate results, with room for the fibits above N.
+	 */
+	static constexpr size_t WORK_LIMBS = LIMBS + 1;
+
+	/** @brief Represents Fibo value by normalized form.
+	 * Fibit at position pos is bit pos % LIMB_BITS of limbs[pos / LIMB_BITS],
+	 * fibits from N upwards are zeros.
+	 */
+	limb limbs[LIMBS];
+
+	/** @brief Normalizes intermediate result.
+	 * Replaces the highest pair of adjacent ones until there are none.
+	 * @param[in,out] words   - WORK_LIMBS limbs, with fibit WORK_LIMBS * LIMB_BITS - 1 equal 0.
+	 */
+	static constexpr void normalize(limb *words) {
+		size_t i = WORK_LIMBS;
+		while (i-- > 0) {
+			limb next = i + 1 < WORK_LIMBS ? words[i + 1] : 0;
+			limb pairs = words[i] & ((words[i] >> 1) | (next << (LIMB_BITS - 1)));
+			if (pairs != 0) {
+				// Para jest najwyzsza, wiec fibit pos + 2 jest zerem. Nowa para moze powstac tylko wyzej.
+				size_t pos = i * LIMB_BITS + LIMB_BITS - 1 - __builtin_clzll(pairs);
+				for (size_t fibit = pos; fibit < pos + 3; fibit++) {
+					words[fibit / LIMB_BITS] ^= limb(1) << (fibit % LIMB_BITS);
+				}
+				i = std::min((pos + 3) / LIMB_BITS + 1, WORK_LIMBS);
+			}
+		}
+	}
+
+	/** @brief Stores normalized intermediate result.
+	 * @param[in] words   - WORK_LIMBS normalized limbs.
+	 * @throws std::overflow_error if the result is longer than N fibits.
+	 */
+	constexpr void assign(const limb *words) {
+		for (size_t i = 0; i < WORK_LIMBS; i++) {
+			limb high = i < N / LIMB_BITS ? 0 : i == N / LIMB_BITS ? words[i] >> (N % LIMB_BITS) : words[i];
+			if (high != 0) {
+				throw std::overflow_error("StaticFibo overflow");
+			}
+		}
+		for (size_t i = 0; i < LIMBS; i++) {
+			limbs[i] = words[i];
+		}
+	}
+
+	/** @brief Applies fibit operation to normalized forms and normalizes the result.
+	 * @param[in] rhs         - reference to StaticFibo.
+	 * @param[in] operation   - function of two limbs.
+	 */
+	template<typename Operation>
+	constexpr void combine(const StaticFibo &rhs, Operation operation) {
+		limb words[WORK_LIMBS] = {};
+		for (size_t i = 0; i < LIMBS; i++) {
+			words[i] = operation(limbs[i], rhs.limbs[i]);
+		}
+		normalize(words);
+		assign(words);
+	}
+
+	/** @brief Returns number of limbs without zero limbs on top.
+	 * @return Number of limbs, 0 for value 0.
+	 */
+	[[nodiscard]] constexpr size_t size() const {
+		size_t count = LIMBS;
+		while (count > 0 && limbs[count - 1] == 0) {
+			count--;
+		}
+		return count;
+	}
+
+	friend class Fibo;
+
+public:
+	/** @brief Creates new StaticFibo with value 0.
+	 */
+	constexpr StaticFibo() : limbs{} {}
+
+	template<typename T, std::enable_if_t<
+			std::is_integral<T>::value
+			&& !std::is_same<char, T>::value
+			&& !std::is_same<bool, T>::value, int> = 0>
+	/** @brief Creates new StaticFibo with given value.
+	 * Constructor is enabled only for integral types excluding char and bool.
+	 * @param[in] n   - value represented by non-negative integer.
+	 * @throws std::overflow_error if @p n needs more than N fibits.
+	 */
+	constexpr StaticFibo(T n) : limbs{} {
+		assert(n >= 0);
+		T f1 = 1;
+		T f2 = 1;
+		size_t pos = 0;
+		while (n >= f2 && n - f2 >= f1) {
+			pos++;
+			T tmp = f2;
+			f2 = f2 + f1;
+			f1 = tmp;
+		}
+		if (n > 0 && pos >= N) {
+			throw std::overflow_error("StaticFibo overflow");
+		}
+		while (n > 0) {
+			if (n >= f2) {
+				limbs[pos / LIMB_BITS] |= limb(1) << (pos % LIMB_BITS);
+				n -= f2;
+			}
+			pos--;
+			T tmp = f1;
+			f1 = f2 - f1;
+			f2 = tmp;
+		}
+		// Nie trzeba normalizowac.
+	}
+
+	/** @brief Creates new StaticFibo with given value.
+	 * @param[in] str   - value represented by description in fibonacci system.
+	 * @throws std::overflow_error if the value needs more than N fibits.
+	 */
+	constexpr explicit StaticFibo(const std::string_view &str) : limbs{} {
+		assert(!str.empty()); // Czy jest niepusta.
+		std::string_view digits = str;
+		while (digits.size() > 1 && digits[0] == '0') {
+			digits.remove_prefix(1);
+		}
+		// Opis zaczynajacy sie od jedynki na k fibitach ma wartosc co najmniej F(k + 1).
+		if (digits.size() > N) {
+			throw std::overflow_error("StaticFibo overflow");
+		}
+		limb words[WORK_LIMBS] = {};
+		size_t pos = 0;
+		for (auto it = digits.crbegin(); it != digits.crend(); it++, pos++) {
+			assert(*it == '0' || *it == '1');
+			words[pos / LIMB_BITS] |= limb(*it == '1') << (pos % LIMB_BITS);
+		}
+		normalize(words);
+		assign(words);
+	}
+
+	/** @brief Creates new StaticFibo with value of narrower StaticFibo.
+	 * @param[in] value   - reference to StaticFibo.
+	 */
+	template<size_t M, std::enable_if_t<M <= N, int> = 0>
+	constexpr StaticFibo(const StaticFibo<M> &value) : limbs{} {
+		for (size_t pos = value.length(); pos-- > 0;) {
+			limbs[pos / LIMB_BITS] |= limb(value.fibit(pos)) << (pos % LIMB_BITS);
+		}
+	}
+
+	/** @brief Creates new StaticFibo with value of wider StaticFibo.
+	 * @param[in] value   - reference to StaticFibo.
+	 * @throws std::overflow_error if @p value is longer than N fibits.
+	 */
+	template<size_t M, std::enable_if_t<(M > N), int> = 0>
+	constexpr explicit StaticFibo(const StaticFibo<M> &value) : limbs{} {
+		if (value.length() > N) {
+			throw std::overflow_error("StaticFibo overflow");
+		}
+		for (size_t pos = value.length(); pos-- > 0;) {
+			limbs[pos / LIMB_BITS] |= limb(value.fibit(pos)) << (pos % LIMB_BITS);
+		}
+	}
+
+	/** @brief Creates new StaticFibo with value of Fibo.
+	 * @param[in] value   - reference to Fibo.
+	 * @throws std::overflow_error if @p value is longer than N fibits.
+	 */
+	explicit StaticFibo(const Fibo &value);
+
+	/** @brief Returns fibit of normalized form at given position.
+	 * @param[in] pos   - position represented by non-negative integer.
+	 * @return Fibit at position pos, @p false above N fibits.
+	 */
+	[[nodiscard]] constexpr bool fibit(size_t pos) const {
+		return pos < N && ((limbs[pos / LIMB_BITS] >> (pos % LIMB_BITS)) & 1) != 0;
+	}
+
+	/** @brief Returns StaticFibo normalized form length.
+	 * @return StaticFibo normalized form length.
+	 */
+	[[nodiscard]] constexpr size_t length() const {
+		size_t count = size();
+		if (count == 0) {
+			return 1;
+		}
+		return count * LIMB_BITS - __builtin_clzll(limbs[count - 1]);
+	}
+
+	/** @brief Adds value to current StaticFibo.
+	 * @param[in] rhs   - value to add represented by reference to StaticFibo.
+	 * @return Reference to current StaticFibo with added value.
+	 * @throws std::overflow_error if the sum is longer than N fibits.
+	 */
+	constexpr StaticFibo &operator+=(const StaticFibo &rhs) {
+		// Jak w Fibo: a + b = (a ^ b) + 2 (a & b), 2F(n) = F(n + 1) + F(n - 2), krok na calych limbach.
+		limb sums[WORK_LIMBS] = {};
+		limb carries[WORK_LIMBS] = {};
+		bool carry = false;
+		for (size_t i = 0; i < LIMBS; i++) {
+			sums[i] = limbs[i] ^ rhs.limbs[i];
+			carries[i] = limbs[i] & rhs.limbs[i];
+			carry = carry || carries[i] != 0;
+		}
+		while (carry) {
+			carry = false;
+			limb nextCarries[WORK_LIMBS] = {};
+			for (size_t i = 0; i < WORK_LIMBS; i++) {
+				// 2F(3) = F(4) + F(2): przeniesienie z pozycji 1 daje jedynke na pozycji 0, a nie -1.
+				limb lower = i > 0 ? carries[i - 1] >> (LIMB_BITS - 1) : (carries[0] >> 1) & 1;
+				limb up = (carries[i] << 1) | lower;
+				limb down = (carries[i] >> 2) | (i + 1 < WORK_LIMBS ? carries[i + 1] << (LIMB_BITS - 2) : 0);
+				limb sum = sums[i];
+				sums[i] = sum ^ up ^ down;
+				nextCarries[i] = (sum & up) | (down & (sum ^ up));
+				carry = carry || nextCarries[i] != 0;
+			}
+			for (size_t i = 0; i < WORK_LIMBS; i++) {
+				carries[i] = nextCarries[i];
+			}
+		}
+		normalize(sums);
+		assign(sums);
+		return *this;
+	}
+
+	/** @brief Changes current StaticFibo by making 'and' operation
+	 * on every fibit at normalized form with given StaticFibo.
+	 * @param[in] rhs   - reference to StaticFibo.
+	 * @return Reference to current changed StaticFibo.
+	 */
+	constexpr StaticFibo &operator&=(const StaticFibo &rhs) {
+		for (size_t i = 0; i < LIMBS; i++) {
+			limbs[i] &= rhs.limbs[i];
+		}
+		// Nie potrzeba normalizacji.
+		return *this;
+	}
+
+	/** @brief Changes current StaticFibo by making 'or' operation
+	 * on every fibit at normalized form with given StaticFibo.
+	 * @param[in] rhs   - reference to StaticFibo.
+	 * @return Reference to current changed StaticFibo.
+	 * @throws std::overflow_error if the result is longer than N fibits.
+	 */
+	constexpr StaticFibo &operator|=(const StaticFibo &rhs) {
+		combine(rhs, [](limb lhs, limb rhs) { return lhs | rhs; });
+		return *this;
+	}
+
+	/** @brief Changes current StaticFibo by making 'xor' operation
+	 * on every fibit at normalized form with given StaticFibo.
+	 * @param[in] rhs   - reference to StaticFibo.
+	 * @return Reference to current changed StaticFibo.
+	 * @throws std::overflow_error if the result is longer than N fibits.
+	 */
+	constexpr StaticFibo &operator^=(const StaticFibo &rhs) {
+		combine(rhs, [](limb lhs, limb rhs) { return lhs ^ rhs; });
+		return *this;
+	}
+
+	/** @brief Changes current StaticFibo by shifting all fibits left.
+	 * @param[in] n   - non-negative integer places to shift left.
+	 * @return Reference to current changed StaticFibo.
+	 * @throws std::overflow_error if the result is longer than N fibits.
+	 */
+	constexpr StaticFibo &operator<<=(size_t n) {
+		if (length() + n > N && *this != StaticFibo()) {
+			throw std::overflow_error("StaticFibo overflow");
+		}
+		size_t limbShift = n / LIMB_BITS;
+		size_t fibitShift = n % LIMB_BITS;
+		for (size_t i = LIMBS; i-- > 0;) {
+			limb shifted = i >= limbShift ? limbs[i - limbShift] << fibitShift : 0;
+			// Przesuniecie o LIMB_BITS nie jest okreslone.
+			if (fibitShift != 0 && i > limbShift) {
+				shifted |= limbs[i - limbShift - 1] >> (LIMB_BITS - fibitShift);
+			}
+			limbs[i] = shifted;
+		}
+		// Przesuniecie zachowuje postac unormowana.
+		return *this;
+	}
+
+	friend constexpr StaticFibo operator+(StaticFibo lhs, const StaticFibo &rhs) {
+		return lhs += rhs;
+	}
+
+	friend constexpr StaticFibo operator&(StaticFibo lhs, const StaticFibo &rhs) {
+		return lhs &= rhs;
+	}
+
+	friend constexpr StaticFibo operator|(StaticFibo lhs, const StaticFibo &rhs) {
+		return lhs |= rhs;
+	}
+
+	friend constexpr StaticFibo operator^(StaticFibo lhs, const StaticFibo &rhs) {
+		return lhs ^= rhs;
+	}
+
+	friend constexpr StaticFibo operator<<(StaticFibo lhs, size_t n) {
+		return lhs <<= n;
+	}
+
+	/** @brief Compares two StaticFibo numbers.
+	 * @param[in] lhs   - reference to first compared StaticFibo.
+	 * @param[in] rhs   - reference to second compared StaticFibo.
+	 * @return @p true if first StaticFibo is smaller than second,
+	 * otherwise @p false.
+	 */
+	friend constexpr bool operator<(const StaticFibo &lhs, const StaticFibo &rhs) {
+		for (size_t i = LIMBS; i-- > 0;) {
+			if (lhs.limbs[i] != rhs.limbs[i]) {
+				return lhs.limbs[i] < rhs.limbs[i];
+			}
+		}
+		return false;
+	}
+
+	/** @brief Compares two StaticFibo numbers.
+	 * @param[in] lhs   - reference to first compared StaticFibo.
+	 * @param[in] rhs   - reference to second compared StaticFibo.
+	 * @return @p true if given numbers are equal, otherwise @p false.
+	 */
+	friend constexpr bool operator==(const StaticFibo &lhs, const StaticFibo &rhs) {
+		for (size_t i = 0; i < LIMBS; i++) {
+			if (lhs.limbs[i] != rhs.limbs[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	friend constexpr bool operator!=(const StaticFibo &lhs, const StaticFibo &rhs) {
+		return !(lhs == rhs);
+	}
+
+	friend constexpr bool operator>(const StaticFibo &lhs, const StaticFibo &rhs) {
+		return rhs < lhs;
+	}
+
+	friend constexpr bool operator<=(const StaticFibo &lhs, const StaticFibo &rhs) {
+		return !(rhs < lhs);
+	}
+
+	friend constexpr bool operator>=(const StaticFibo &lhs, const StaticFibo &rhs) {
+		return !(lhs < rhs);
+	}
+
+	/** @brief operator << Prints to given stream, given StaticFibo normalized form.
+	 * @param[in] stream   - reference to stream
+	 * @param[in] lhs      - reference to StaticFibo
+	 * @return Reference to stream.
+	 */
+	friend std::ostream &operator<<(std::ostream &stream, const StaticFibo &lhs) {
+		for (size_t i = lhs.length(); i-- > 0;) {
+			stream << lhs.fibit(i);
+		}
+		return stream;
+	}
+};
+
+namespace fibo {
+	/** @brief Number of fibits enough for every value of given number of decimal digits.
+	 * 10 < F(7) = 13, so every digit adds at most 5 fibits.
+	 */
+	constexpr size_t decimal_fibits(size_t digits) {
+		return 5 * digits + 1;
+	}
+
+	/** @brief Value of decimal literal, computed by Horner's method.
+	 * @tparam Digits   - characters of the literal.
+	 */
+	template<char... Digits>
+	constexpr StaticFibo<decimal_fibits(sizeof...(Digits))> decimal_literal() {
+		using value_type = StaticFibo<decimal_fibits(sizeof...(Digits))>;
+		value_type value;
+		for (char digit : {Digits...}) {
+			if (digit == '\'') {
+				continue;
+			}
+			if (digit < '0' || digit > '9') {
+				throw std::invalid_argument("Fibo literal has to be decimal");
+			}
+			value_type twice = value + value;
+			value_type eightTimes = twice + twice;
+			eightTimes += eightTimes;
+			value = eightTimes + twice + value_type(digit - '0');
+		}
+		return value;
+	}
+
+	/** @brief Values of decimal literals, initialized at compile time.
+	 */
+	template<char... Digits>
+	constexpr auto DECIMAL_LITERAL = decimal_literal<Digits...>();
+
+	namespace literals {
+		/** @brief Creates StaticFibo with value of decimal literal at compile time.
+		 * @return StaticFibo long enough for every literal of the same number of digits.
+		 */
+		template<char... Digits>
+		constexpr auto operator ""_fibo() {
+			return DECIMAL_LITERAL<Digits...>;
+		}
+	}
+}
+
+#endif /* FIBO_STATIC_H */
@@ -3,10 +3,39 @@
 #include "poset.h"
 #include <unordered_map>
 #include <unordered_set>
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <deque>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <array>
+#include <set>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <fstream>
+#include <type_traits>
+#include <chrono>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define POSET_X86_KERNELS
+#endif
 
 using namespace std;
 
@@ -16,495 +45,3223 @@ const bool debug = false;
 const bool debug = true;
 #endif
 
+/// Printing of the Debug version can be turned off at run time with POSET_DEBUG=0.
+static bool debug_printing() {
+    static const bool printing = getenv("POSET_DEBUG") == nullptr || strcmp(getenv("POSET_DEBUG"), "0") != 0;
+    return printing;
+}
+
 #define MAKE_STRING(x) "\"" << (x == nullptr ? "NULL" : x) << "\""
 
 /// Macros printing information about repeated error types, assume that x is not NULL.
 #define POSET_NOT_EXIST(x) "poset " << x << " does not exist"
 #define ELEMENT_NOT_EXIST(x) "element \"" << x << "\" does not exist"
+#define ELEMENT_HANDLE_NOT_EXIST(x) "element handle " << x << " does not exist"
+#define SNAPSHOT_NOT_EXIST(x) "snapshot " << x << " does not exist"
+#define FILE_INVALID(x) "file \"" << x << "\" cannot be read as a poset"
 #define INVALID_VALUE(x) "invalid " << #x << " (NULL)"
 
 /// Macro creating information about relation (x,y), assumes that x, y are not NULL.
 #define RELATION(x, y) "relation (\"" << x << "\", \"" << y << "\")"
 
 /// Macro printing information if version is Debug, assumes that x is not NULL.
-#define DEBUG(x) do {if (debug){cerr << __func__ << x << endl;}} while(0)
+/// The line is built first and written at once, as cerr would flush every part.
+#define DEBUG(x) do {if (debug && debug_printing()){ostringstream line; line << __func__ << x << '\n'; cerr << line.str();}} while(0)
+
+/// Macro tracing the call of the enclosing function poset_<operation> of the library, see trace_scope.
+#define TRACE(operation, id) trace_scope traceScope(poset_operation_##operation, id)
 
-/// Macro finding relations and id of a given element.
-#define FIND_RELATIONS_AND_ID(elementId, relations, transposedRelations, value) \
+/// Macro recording the outcome of the call other than done and printing information about it.
+#define RESULT(outcome, x) do {traceScope.outcome_is(poset_outcome_##outcome); DEBUG(x);} while(0)
+
+/// Macro finding id of a given element of addedToPoset.
+#define FIND_ELEMENT_ID(elementId, value) \
 do { \
-    elementId = get_poset_element_id(id, value); \
+    elementId = find_element_id(*addedToPoset, value); \
     if (elementId == INVALID_POSET_ELEMENT_ID) { \
-        DEBUG(": poset " << id << ", " << ELEMENT_NOT_EXIST(value)); \
+        RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_NOT_EXIST(value)); \
         return false; \
     } \
-\
-    auto elementIterator = posetToBeAddedTo.find(elementId);  \
-    assert(elementIterator != posetToBeAddedTo.end()); \
-    \
-    relations = (elementIterator->second).first; \
-    transposedRelations = (elementIterator->second).second;  \
 } while(0)
 
 namespace {
     using poset_id = unsigned long;
+    /// Dense index of an element inside its poset.
     using poset_element_id = uint32_t;
     using poset_element_name = string;
-    using relations = unordered_set<poset_element_id>;
-    using poset_relations = pair<relations, relations>;
-    using poset = unordered_map<poset_element_id, poset_relations>;
-    using name_to_element_id = unordered_map<poset_element_name, poset_element_id>;
-
-    const poset_element_id INVALID_POSET_ELEMENT_ID = 0;
-    const poset_element_id INITIAL_POSET_ELEMENT_ID = 1;
+    using relations_word = uint64_t;
+    /// Snapshots of a poset are numbered by epochs, rows remember the epoch they were written in.
+    using relations_epoch = uint64_t;
+    /// Id of a name interned once for all the posets.
+    using name_id = uint32_t;
+    /// Interned name and the number of posets having an element with that name.
+    using interned_name = pair<poset_element_name, size_t>;
+    /// Keys view the names owned by internedNames().
+    using name_to_name_id = unordered_map<string_view, name_id>;
+    using name_to_element_id = unordered_map<name_id, poset_element_id>;
+    /// Name ids indexed by element id.
+    using element_names = vector<name_id>;
+    /// Number of times the element id was given to an element of the poset.
+    using element_generation = uint32_t;
+    /// Element handle of the public API: generation of the element id in the upper
+    /// half and element id + 1 in the lower half, so that 0 is never valid.
+    using poset_element_handle = uint64_t;
+    using snapshot_id = unsigned long;
+
+    const poset_element_id INVALID_POSET_ELEMENT_ID = numeric_limits<poset_element_id>::max();
+    const name_id INVALID_NAME_ID = numeric_limits<name_id>::max();
+    const poset_element_handle INVALID_POSET_ELEMENT_HANDLE = 0;
+    const int HANDLE_GENERATION_SHIFT = numeric_limits<poset_element_id>::digits;
     const poset_id INITIAL_POSET_ID = 0;
+    const snapshot_id INVALID_SNAPSHOT_ID = 0;
+    const snapshot_id INITIAL_SNAPSHOT_ID = 1;
+    const size_t RELATIONS_WORD_BITS = numeric_limits<relations_word>::digits;
+    const size_t POSET_REGISTRY_SHARDS = 64;
+    const uint64_t POSET_IMAGE_MAGIC = 0x5445534f50314e4a; // "JN1POSET"
+    const uint64_t POSET_IMAGE_VERSION = 1;
+    const size_t POSET_IMAGE_HEADER_WORDS = 6;
+    const size_t MAX_TRACE_CAPACITY = size_t(1) << 24;
+    using image_slot = uint32_t;
 
-    ///Structure mapping poset_id to poset.
-    unordered_map<poset_id, poset> &posets() {
-        static unordered_map<poset_id, poset> posets;
-        return posets;
-    }
+    /*
+     * Hash of a name used by the hash tables of poset images (64-bit FNV-1a),
+     * fixed so that images do not depend on the standard library.
+     */
+    uint64_t image_name_hash(string_view name) {
+        uint64_t hash = 0xcbf29ce484222325;
+        for (char c : name) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+        }
 
-    ///Structure mapping poset_id and name of element to its id.
-    unordered_map<poset_id, name_to_element_id> &posetIdToMapOfNames() {
-        static unordered_map<poset_id, unordered_map<poset_element_name, poset_element_id>> nameToId;
-        return nameToId;
+        return hash;
     }
 
-    poset_id nextPosetId = INITIAL_POSET_ID;
-    poset_element_id nextPosetElementId = INITIAL_POSET_ELEMENT_ID;
-
     /*
-     * INVALID_POSET_ELEMENT_ID if the given id doesn't belong
-     * to any poset or if there is no element in that poset with the given name.
-     * Otherwise, returns id of the poset element.
+     * Poset written by poset_save and mapped into memory, queried in place.
+     * The file consists of a header of POSET_IMAGE_HEADER_WORDS 64-bit words:
+     * magic, version, number of elements n, words per row, slots of the hash table
+     * and size of names; followed by sections padded to 8 bytes: n + 1 offsets of
+     * names, hash table of element ids + 1 (0 is an empty slot, linear probing),
+     * n successor rows, n predecessor rows and names, each terminated by '\0'.
+     * Numbers are stored in the native byte order.
      */
-    poset_element_id get_poset_element_id(unsigned long id, char const *value) {
-        auto posetIdToMapIterator = posetIdToMapOfNames().find(id);
-        if (posetIdToMapIterator == posetIdToMapOfNames().end()) {
-            return INVALID_POSET_ELEMENT_ID;
+    class poset_image {
+    public:
+        /// Maps the file, returns nullptr if it cannot be mapped or is not an image.
+        static shared_ptr<const poset_image> map_file(char const *path);
+
+        poset_image(const poset_image &) = delete;
+        poset_image &operator=(const poset_image &) = delete;
+
+        ~poset_image() {
+            munmap(mapping, mappingSize);
+        }
+
+        size_t size() const {
+            return elementCount;
         }
 
-        auto nameToIdIterator = (posetIdToMapIterator->second).find(value);
-        if (nameToIdIterator == ((posetIdToMapIterator->second)).end()) {
+        size_t row_words() const {
+            return rowWords;
+        }
+
+        /// Returns id of the element or INVALID_POSET_ELEMENT_ID.
+        poset_element_id find(string_view name) const {
+            if (slotCount == 0) {
+                return INVALID_POSET_ELEMENT_ID;
+            }
+
+            // Loaded tables have an empty slot, the bound only guards against a broken one.
+            uint64_t slot = image_name_hash(name) & (slotCount - 1);
+            for (uint64_t probe = 0; probe < slotCount; probe++, slot = (slot + 1) & (slotCount - 1)) {
+                image_slot elementSlot = slots[slot];
+                if (elementSlot == 0) {
+                    return INVALID_POSET_ELEMENT_ID;
+                }
+                if (elementSlot <= elementCount && this->name(elementSlot - 1) == name) {
+                    return elementSlot - 1;
+                }
+            }
+
             return INVALID_POSET_ELEMENT_ID;
         }
 
-        return nameToIdIterator->second;
-    }
+        string_view name(poset_element_id elementId) const {
+            return string_view(names + nameOffsets[elementId], nameOffsets[elementId + 1] - nameOffsets[elementId] - 1);
+        }
 
-    /*
-     * If the parametr transpose has value true, returns the first element of
-     * posetRelations, otherwise returns the second element.
-     */
-    inline relations &getRelations(poset_relations &posetRelations, bool transpose) {
-        if (transpose) {
-            return posetRelations.first;
+        const relations_word *successors(poset_element_id elementId) const {
+            return successorRows + elementId * rowWords;
         }
 
-        return posetRelations.second;
-    }
+        const relations_word *predecessors(poset_element_id elementId) const {
+            return predecessorRows + elementId * rowWords;
+        }
+
+        bool test(poset_element_id first, poset_element_id second) const {
+            return (successors(first)[second / RELATIONS_WORD_BITS] >> (second % RELATIONS_WORD_BITS)) & 1;
+        }
+
+    private:
+        poset_image(void *mapping, size_t mappingSize) : mapping(mapping), mappingSize(mappingSize) {}
+
+        void *mapping;
+        size_t mappingSize;
+        uint64_t elementCount = 0;
+        uint64_t rowWords = 0;
+        uint64_t slotCount = 0;
+        const uint64_t *nameOffsets = nullptr;
+        const image_slot *slots = nullptr;
+        const relations_word *successorRows = nullptr;
+        const relations_word *predecessorRows = nullptr;
+        const char *names = nullptr;
+    };
 
     /*
-     * Iterates over relations of the elements of toIterate and removes the
-     * element with the given id from those relations.
+     * Returns size rounded up to a multiple of 8 bytes.
      */
-    void iterate_and_remove(poset_element_id id, const relations &toIterate, poset &posetRemoveFrom, bool transpose) {
-        for (poset_element_id i : toIterate) {
-            assert(posetRemoveFrom.find(i) != posetRemoveFrom.end());
+    inline uint64_t image_padded(uint64_t size) {
+        return (size + 7) / 8 * 8;
+    }
 
-            relations &tmpRelations = getRelations(posetRemoveFrom[i], transpose);
+    shared_ptr<const poset_image> poset_image::map_file(char const *path) {
+        int descriptor = open(path, O_RDONLY);
+        if (descriptor < 0) {
+            return nullptr;
+        }
 
-            auto tmpRemove = tmpRelations.find(id);
-            assert(tmpRemove != tmpRelations.end());
+        struct stat fileStatus{};
+        if (fstat(descriptor, &fileStatus) != 0
+            || static_cast<uint64_t>(fileStatus.st_size) < POSET_IMAGE_HEADER_WORDS * sizeof(uint64_t)) {
+            close(descriptor);
+            return nullptr;
+        }
 
-            tmpRelations.erase(tmpRemove);
+        auto fileSize = static_cast<size_t>(fileStatus.st_size);
+        void *mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        close(descriptor);
+        if (mapping == MAP_FAILED) {
+            return nullptr;
         }
-    }
 
-    /*
-     * Adds the elements of relationsToBeAdded to relationsToBeAddedTo so that the
-     * relations remain trasnitive.
-     */
-    void iterate_and_add_relations(const relations &relationsToBeAdded, poset &posetToBeAddedTo,
-                                   const relations &relationsToBeAddedTo, bool transpose) {
-        for (poset_element_id i : relationsToBeAdded) {
-            auto tmpIterator = posetToBeAddedTo.find(i);
-            assert(tmpIterator != posetToBeAddedTo.end());
+        shared_ptr<poset_image> image(new poset_image(mapping, fileSize));
+        const auto *header = static_cast<const uint64_t *>(mapping);
+        const auto *bytes = static_cast<const char *>(mapping);
+
+        image->elementCount = header[2];
+        image->rowWords = header[3];
+        image->slotCount = header[4];
+        uint64_t namesSize = header[5];
+
+        // Sizes are checked one by one, so that computing the next one cannot overflow.
+        uint64_t elementCount = image->elementCount;
+        bool valid = header[0] == POSET_IMAGE_MAGIC && header[1] == POSET_IMAGE_VERSION
+                     && elementCount < INVALID_POSET_ELEMENT_ID
+                     && image->rowWords == (elementCount + RELATIONS_WORD_BITS - 1) / RELATIONS_WORD_BITS
+                     && (image->slotCount & (image->slotCount - 1)) == 0
+                     && image->slotCount > elementCount && image->slotCount <= 2 * elementCount + 2
+                     && namesSize <= fileSize;
+        if (!valid) {
+            return nullptr;
+        }
 
-            relations &tmpRelations = getRelations(tmpIterator->second, transpose);
+        uint64_t offset = POSET_IMAGE_HEADER_WORDS * sizeof(uint64_t);
+        image->nameOffsets = reinterpret_cast<const uint64_t *>(bytes + offset);
+        offset += (elementCount + 1) * sizeof(uint64_t);
+        image->slots = reinterpret_cast<const image_slot *>(bytes + offset);
+        offset += image_padded(image->slotCount * sizeof(image_slot));
+        uint64_t rowsSize = elementCount * image->rowWords * sizeof(relations_word);
+        image->successorRows = reinterpret_cast<const relations_word *>(bytes + offset);
+        offset += rowsSize;
+        image->predecessorRows = reinterpret_cast<const relations_word *>(bytes + offset);
+        offset += rowsSize;
+        image->names = bytes + offset;
+        offset += image_padded(namesSize);
+
+        if (offset != fileSize || image->nameOffsets[0] != 0 || image->nameOffsets[elementCount] != namesSize) {
+            return nullptr;
+        }
 
-            for (poset_element_id j : relationsToBeAddedTo) {
-                tmpRelations.insert(j);
+        for (uint64_t i = 0; i < elementCount; i++) {
+            uint64_t begin = image->nameOffsets[i], end = image->nameOffsets[i + 1];
+            if (end <= begin || end > namesSize || image->names[end - 1] != '\0') {
+                return nullptr;
             }
         }
-    }
 
-    /*
-     * Removes element's id from the map posetIdToMapOfNames.
-     * Is called in purpose to preserve the invariant, that
-     * the element is present in poset iff some id belongs to
-     * its name and poset.
-     */
-    void remove_element_id(poset_id id, char const *value) {
-        auto mapIterator1 = posetIdToMapOfNames().find(id);
-        unordered_map<string, poset_element_id> &map = mapIterator1->second;
-        auto mapIterator2 = map.find(value);
+        // Ids in the table must name elements and some slot must be empty, so that probing ends.
+        bool emptySlot = false;
+        for (uint64_t slot = 0; slot < image->slotCount; slot++) {
+            if (image->slots[slot] > elementCount) {
+                return nullptr;
+            }
+            emptySlot = emptySlot || image->slots[slot] == 0;
+        }
+        if (!emptySlot) {
+            return nullptr;
+        }
+
+        // Bits past the last element would be read as relations with elements that do not exist.
+        uint64_t tailBits = elementCount % RELATIONS_WORD_BITS;
+        if (tailBits != 0) {
+            relations_word tailMask = ~relations_word(0) << tailBits;
+            for (uint64_t i = 0; i < elementCount; i++) {
+                if ((image->successors(i)[image->rowWords - 1] & tailMask) != 0
+                    || (image->predecessors(i)[image->rowWords - 1] & tailMask) != 0) {
+                    return nullptr;
+                }
+            }
+        }
 
-        map.erase(mapIterator2);
+        return image;
     }
 
+    /// Elements covering the element (first) and covered by it (second).
+    using covering_relations = pair<vector<poset_element_id>, vector<poset_element_id>>;
+
     /*
-     * Function that inserts a new element to a given poset.
+     * Transitive reduction of a poset: only the covering relations of the elements
+     * are kept, so memory is proportional to the size of the Hasse diagram.
+     * Queries use an index built by a depth-first search over the covering relations.
+     * Preorder intervals of the search tree prove that an element precedes another one,
+     * postorder intervals of all the elements it precedes prove that it does not.
+     * Only the remaining queries search the diagram, skipping elements which the
+     * intervals rule out. A change makes the index stale until a query rebuilds it.
      */
-    bool poset_insert_aux(poset &toInsert) {
-        assert(toInsert.find(nextPosetElementId) == toInsert.end());
+    class hasse_diagram {
+    public:
+        hasse_diagram() = default;
 
-        toInsert[nextPosetElementId];
+        /// Copies the covering relations only, the copy builds its own index.
+        hasse_diagram(const hasse_diagram &other) : elements(other.elements) {}
 
-        toInsert[nextPosetElementId].first.insert(nextPosetElementId);
-        toInsert[nextPosetElementId].second.insert(nextPosetElementId);
+        hasse_diagram &operator=(const hasse_diagram &) = delete;
 
-        return true;
-    }
+        /// Elements covering the element, or covered by it if transpose is true.
+        const vector<poset_element_id> &neighbours(poset_element_id elementId, bool transpose) const {
+            return transpose ? elements[elementId].second : elements[elementId].first;
+        }
 
-}
+        bool covers(poset_element_id lower, poset_element_id upper) const {
+            const vector<poset_element_id> &covering = elements[lower].first;
 
-namespace jnp1 {
+            return find(covering.begin(), covering.end(), upper) != covering.end();
+        }
 
-    unsigned long poset_new(void) {
-        DEBUG("()");
+        /*
+         * Returns true if the first element precedes the second one. If the index
+         * is stale, builds it when buildIndex is true and searches without it otherwise.
+         * May be called concurrently, as long as the diagram is not changed meanwhile.
+         */
+        bool reaches(poset_element_id from, poset_element_id to, bool buildIndex = true) const;
+
+        /*
+         * Calls function for the element and all the elements it precedes,
+         * or all the elements preceding it if transpose is true.
+         */
+        template<typename Function>
+        void for_each_reachable(poset_element_id from, bool transpose, Function function) const {
+            vector<poset_element_id> toVisit(1, from);
+            unordered_set<poset_element_id> visited(toVisit.begin(), toVisit.end());
+
+            while (!toVisit.empty()) {
+                poset_element_id current = toVisit.back();
+                toVisit.pop_back();
+                function(current);
+
+                for (poset_element_id next : transpose ? elements[current].second : elements[current].first) {
+                    if (visited.insert(next).second) {
+                        toVisit.push_back(next);
+                    }
+                }
+            }
+        }
 
-        posets()[nextPosetId];
-        posetIdToMapOfNames()[nextPosetId];
+        /*
+         * Functions below change the diagram so that it remains the transitive
+         * reduction of the poset. Assume that nobody reads the diagram meanwhile.
+         */
+        /// Assumes that the id is free or follows all the used ids.
+        void insert(poset_element_id elementId);
+
+        void remove(poset_element_id elementId);
+
+        /// Assumes that the elements are not in relation.
+        void add(poset_element_id lower, poset_element_id upper);
+
+        /// Assumes that upper covers lower.
+        void remove_covering(poset_element_id lower, poset_element_id upper);
+
+        /*
+         * Returns the diagram of the elements of liveIds only, with element i
+         * renumbered to newIds[i]. Assumes that no other element is in relation.
+         */
+        shared_ptr<hasse_diagram> renumbered(const vector<poset_element_id> &liveIds,
+                                             const vector<poset_element_id> &newIds) const {
+            auto diagram = make_shared<hasse_diagram>();
+            diagram->elements.reserve(liveIds.size());
+
+            for (poset_element_id i : liveIds) {
+                covering_relations &renumberedRelations = diagram->elements.emplace_back();
+                for (poset_element_id j : elements[i].first) {
+                    renumberedRelations.first.push_back(newIds[j]);
+                }
+                for (poset_element_id j : elements[i].second) {
+                    renumberedRelations.second.push_back(newIds[j]);
+                }
+            }
 
-        DEBUG(": poset " << nextPosetId << " created");
+            return diagram;
+        }
 
-        return nextPosetId++;
-    }
+    private:
+        void link(poset_element_id lower, poset_element_id upper) {
+            elements[lower].first.push_back(upper);
+            elements[upper].second.push_back(lower);
+        }
 
-    void poset_delete(unsigned long id) {
-        DEBUG("(" << id << ")");
+        static void unlink(vector<poset_element_id> &covering, poset_element_id elementId) {
+            auto elementIterator = find(covering.begin(), covering.end(), elementId);
+            assert(elementIterator != covering.end());
 
-        auto posetToBeDeletedIterator = posets().find(id);
-        if (posetToBeDeletedIterator == posets().end()) {
-            DEBUG(": " << POSET_NOT_EXIST(id));
-            return;
+            *elementIterator = covering.back();
+            covering.pop_back();
         }
 
-        auto idMapIterator = posetIdToMapOfNames().find(id);
-        assert(idMapIterator != posetIdToMapOfNames().end());
+        void unlink(poset_element_id lower, poset_element_id upper) {
+            unlink(elements[lower].first, upper);
+            unlink(elements[upper].second, lower);
+        }
 
-        posetIdToMapOfNames().erase(idMapIterator);
-        posets().erase(posetToBeDeletedIterator);
+        /*
+         * Elements visited by a search of the diagram in one direction, expanded one
+         * at a time, so that searches in both directions can advance together.
+         */
+        struct search_frontier {
+            search_frontier(poset_element_id from, bool transpose) : toExpand(1, from), visited{from},
+                                                                     transpose(transpose) {}
 
-        DEBUG(": poset " << id << " deleted");
-    }
+            bool exhausted() const {
+                return expanded == toExpand.size();
+            }
 
-    size_t poset_size(unsigned long id) {
-        DEBUG("(" << id << ")");
+            /// Covering relations of the elements expanded so far and the next one, in both directions.
+            size_t work_after_next(const hasse_diagram &diagram) const {
+                const covering_relations &next = diagram.elements[toExpand[expanded]];
 
-        auto posetIterator = posets().find(id);
+                return work + next.first.size() + next.second.size();
+            }
 
-        if (posetIterator == posets().end()) {
-            DEBUG(": " << POSET_NOT_EXIST(id));
+            /*
+             * Returns true if the search should advance rather than other, the one which
+             * has less work done, so that an element with many covering relations is
+             * expanded only if the other search does not run out first.
+             */
+            bool goes_before(const search_frontier &other, const hasse_diagram &diagram) const {
+                return work_after_next(diagram) <= other.work_after_next(diagram);
+            }
 
-            return 0;
-        }
+            /// Visits the elements covering (or covered by) the next element, returns them.
+            const vector<poset_element_id> &expand(const hasse_diagram &diagram) {
+                work = work_after_next(diagram);
 
-        size_t size = (posetIterator->second).size();
-        DEBUG(": poset " << id << " contains " << size << " element(s)");
+                const covering_relations &next = diagram.elements[toExpand[expanded++]];
+                const vector<poset_element_id> &covering = transpose ? next.second : next.first;
 
-        return size;
-    }
+                for (poset_element_id i : covering) {
+                    if (visited.insert(i).second) {
+                        toExpand.push_back(i);
+                    }
+                }
 
-    bool poset_insert(unsigned long id, char const *value) {
-        DEBUG("(" << id << ", " << MAKE_STRING(value) << ")");
+                return covering;
+            }
 
-        if (value == nullptr) {
-            DEBUG(": " << INVALID_VALUE(value));
+            vector<poset_element_id> toExpand;
+            unordered_set<poset_element_id> visited;
+            size_t expanded = 0;
+            size_t work = 0;
+            bool transpose;
+        };
 
-            return false;
+        /// True if the element is in the search subtree of from, so from precedes it.
+        bool subtree_contains(poset_element_id from, poset_element_id to) const {
+            return preorder[from] <= preorder[to] && preorder[to] < subtreeEnd[from];
         }
 
-        auto posetToBeInsertedIterator = posets().find(id);
-        if (posetToBeInsertedIterator == posets().end()) {
-            DEBUG(": " << POSET_NOT_EXIST(id));
-
-            return false;
+        /// False if the intervals prove that from does not precede to.
+        bool may_reach(poset_element_id from, poset_element_id to) const {
+            return lowest[from] <= lowest[to] && postorder[to] <= postorder[from];
         }
 
-        if (get_poset_element_id(id, value) != INVALID_POSET_ELEMENT_ID) {
-            DEBUG (": poset " << id << ", element \"" << value << "\" already exists");
-
-            return false;
+        /*
+         * Elements to visit and marks of the visited ones of indexed searches, kept by
+         * every thread between its queries, so that they allocate no memory once the
+         * space has grown to the poset. An element is visited if its mark is the mark
+         * of the current search.
+         */
+        struct search_scratch {
+            vector<poset_element_id> toVisit;
+            vector<uint32_t> marks;
+            uint32_t mark = 0;
+        };
+
+        bool search(poset_element_id from, poset_element_id to, bool indexed) const;
+
+        void build_index() const;
+
+        vector<covering_relations> elements;
+
+        mutable mutex indexLock;
+        mutable atomic<bool> indexBuilt{false};
+        /// Preorder number of the element and the first number following its search subtree.
+        mutable vector<poset_element_id> preorder, subtreeEnd;
+        /// Postorder number of the element and the least one among the elements it precedes.
+        mutable vector<poset_element_id> postorder, lowest;
+    };
+
+    bool hasse_diagram::reaches(poset_element_id from, poset_element_id to, bool buildIndex) const {
+        bool indexed = indexBuilt.load(memory_order_acquire);
+        if (!indexed && buildIndex) {
+            lock_guard<mutex> lock(indexLock);
+            if (!indexBuilt.load(memory_order_relaxed)) {
+                build_index();
+                indexBuilt.store(true, memory_order_release);
+            }
+            indexed = true;
         }
 
-        poset &posetToBeInserted = posetToBeInsertedIterator->second;
-        poset_insert_aux(posetToBeInserted);
-
-        assert(posetIdToMapOfNames().find(id) != posetIdToMapOfNames().end());
-        assert(posetIdToMapOfNames()[id].find(value) == posetIdToMapOfNames()[id].end());
-
-        posetIdToMapOfNames()[id][value] = nextPosetElementId;
-
-        nextPosetElementId++;
-
-        DEBUG(": poset " << id << ", element \"" << value << "\" inserted");
-
-        return true;
+        return search(from, to, indexed);
     }
 
-    bool poset_remove(unsigned long id, char const *value) {
-        DEBUG("(" << id << ", " << MAKE_STRING(value) << ")");
+    bool hasse_diagram::search(poset_element_id from, poset_element_id to, bool indexed) const {
+        if (from == to) {
+            return true;
+        }
+        if (indexed && (subtree_contains(from, to) || !may_reach(from, to))) {
+            return subtree_contains(from, to);
+        }
 
-        if (value == nullptr) {
-            DEBUG(": " << INVALID_VALUE(value));
+        if (!indexed) {
+            // Searches from both ends, so that it stops as soon as either of them runs out.
+            search_frontier above(from, false), below(to, true);
+            while (!above.exhausted() && !below.exhausted()) {
+                search_frontier &advanced = above.goes_before(below, *this) ? above : below;
+                const search_frontier &other = &advanced == &above ? below : above;
+
+                for (poset_element_id i : advanced.expand(*this)) {
+                    if (other.visited.count(i) != 0) {
+                        return true;
+                    }
+                }
+            }
 
             return false;
         }
 
-        auto posetRemoveFromIterator = posets().find(id);
-        if (posetRemoveFromIterator == posets().end()) {
-            DEBUG(": " << POSET_NOT_EXIST(id));
+        thread_local search_scratch scratch;
+        if (scratch.marks.size() < elements.size()) {
+            scratch.marks.resize(elements.size(), 0);
+        }
+        if (++scratch.mark == 0) {
+            fill(scratch.marks.begin(), scratch.marks.end(), 0);
+            scratch.mark = 1;
+        }
 
-            return false;
+        vector<poset_element_id> &toVisit = scratch.toVisit;
+        toVisit.assign(1, from);
+        scratch.marks[from] = scratch.mark;
+
+        while (!toVisit.empty()) {
+            poset_element_id current = toVisit.back();
+            toVisit.pop_back();
+
+            for (poset_element_id next : elements[current].first) {
+                if (subtree_contains(next, to)) {
+                    return true;
+                }
+                if (may_reach(next, to) && scratch.marks[next] != scratch.mark) {
+                    scratch.marks[next] = scratch.mark;
+                    toVisit.push_back(next);
+                }
+            }
         }
-        poset &posetRemoveFrom = posetRemoveFromIterator->second;
 
+        return false;
+    }
+
+    void hasse_diagram::build_index() const {
+        size_t count = elements.size();
+        preorder.assign(count, INVALID_POSET_ELEMENT_ID);
+        subtreeEnd.assign(count, 0);
+        postorder.assign(count, 0);
+        lowest.assign(count, 0);
 
-        poset_element_id elementToBeRemovedId = get_poset_element_id(id, value);
-        if (elementToBeRemovedId == 0) {
-            DEBUG(": poset " << id << ", " << ELEMENT_NOT_EXIST(value));
+        poset_element_id nextPreorder = 0, nextPostorder = 0;
+        // Elements on the path from the root and the number of their covering elements visited so far.
+        vector<pair<poset_element_id, size_t>> path;
 
-            return false;
+        // Every element is preceded by a minimal one, so searching from those visits all of them.
+        for (poset_element_id root = 0; root < count; root++) {
+            if (!elements[root].second.empty()) {
+                continue;
+            }
+
+            preorder[root] = nextPreorder++;
+            path.emplace_back(root, 0);
+
+            while (!path.empty()) {
+                poset_element_id current = path.back().first;
+                const vector<poset_element_id> &covering = elements[current].first;
+
+                if (path.back().second < covering.size()) {
+                    poset_element_id next = covering[path.back().second++];
+                    if (preorder[next] == INVALID_POSET_ELEMENT_ID) {
+                        preorder[next] = nextPreorder++;
+                        path.emplace_back(next, 0);
+                    }
+                    continue;
+                }
+
+                // The relation is acyclic, so all the covering elements are finished by now.
+                subtreeEnd[current] = nextPreorder;
+                postorder[current] = nextPostorder++;
+                lowest[current] = postorder[current];
+                for (poset_element_id next : covering) {
+                    lowest[current] = min(lowest[current], lowest[next]);
+                }
+
+                path.pop_back();
+            }
         }
-        remove_element_id(id, value);
 
-        auto elementToBeRemovedIterator = posetRemoveFrom.find(elementToBeRemovedId);
-        assert(posetRemoveFrom.find(elementToBeRemovedId) != posetRemoveFrom.end());
+        assert(nextPreorder == count);
+    }
 
-        poset_relations &elementToBeRemovedRelations = posetRemoveFrom[elementToBeRemovedId];
+    void hasse_diagram::insert(poset_element_id elementId) {
+        indexBuilt.store(false, memory_order_relaxed);
 
-        //Deleting all the relations that the element to be deleted is in
-        iterate_and_remove(elementToBeRemovedId, elementToBeRemovedRelations.first, posetRemoveFrom, false);
+        if (elementId == elements.size()) {
+            elements.emplace_back();
+        }
+        assert(elements[elementId].first.empty() && elements[elementId].second.empty());
+    }
 
-        //Deleting all the transposed relations that the element to be deleted is in
-        iterate_and_remove(elementToBeRemovedId, elementToBeRemovedRelations.second, posetRemoveFrom, true);
+    void hasse_diagram::remove(poset_element_id elementId) {
+        indexBuilt.store(false, memory_order_relaxed);
 
-        posetRemoveFrom.erase(elementToBeRemovedIterator);
+        covering_relations removed = move(elements[elementId]);
+        elements[elementId] = covering_relations();
 
-        DEBUG(": poset " << id << ", element \"" << value << "\" removed");
+        for (poset_element_id lower : removed.second) {
+            unlink(elements[lower].first, elementId);
+        }
+        for (poset_element_id upper : removed.first) {
+            unlink(elements[upper].second, elementId);
+        }
 
-        return true;
+        // Relations which went through the removed element now need covering relations of their own.
+        for (poset_element_id lower : removed.second) {
+            for (poset_element_id upper : removed.first) {
+                if (!search(lower, upper, false)) {
+                    link(lower, upper);
+                }
+            }
+        }
     }
 
-    bool poset_add(unsigned long id, char const *value1, char const *value2) {
-        DEBUG("(" << id << ", " << MAKE_STRING(value1) << ", " << MAKE_STRING(value2) << ")");
+    void hasse_diagram::add(poset_element_id lower, poset_element_id upper) {
+        indexBuilt.store(false, memory_order_relaxed);
+
+        // Covering relations from below lower to above upper are implied by the new one.
+        // They are found from the smaller of both sets, collected together.
+        search_frontier belowLower(lower, true), aboveUpper(upper, false);
+        while (!belowLower.exhausted() && !aboveUpper.exhausted()) {
+            if (belowLower.goes_before(aboveUpper, *this)) {
+                belowLower.expand(*this);
+            } else {
+                aboveUpper.expand(*this);
+            }
+        }
 
-        if (value1 == nullptr || value2 == nullptr) {
-            if (value1 == nullptr) {
-                DEBUG(": " << INVALID_VALUE(value1));
+        vector<pair<poset_element_id, poset_element_id>> implied;
+        if (aboveUpper.exhausted()) {
+            for (poset_element_id j : aboveUpper.toExpand) {
+                for (poset_element_id i : elements[j].second) {
+                    if (aboveUpper.visited.count(i) == 0 && search(i, lower, false)) {
+                        implied.emplace_back(i, j);
+                    }
+                }
             }
-            if (value2 == nullptr) {
-                DEBUG(": " << INVALID_VALUE(value2));
+        } else {
+            for (poset_element_id i : belowLower.toExpand) {
+                for (poset_element_id j : elements[i].first) {
+                    if (belowLower.visited.count(j) == 0 && search(upper, j, false)) {
+                        implied.emplace_back(i, j);
+                    }
+                }
             }
-            return false;
         }
 
-        auto posetToBeAddedToIterator = posets().find(id);
-        if (posetToBeAddedToIterator == posets().end()) {
-            DEBUG(": " << POSET_NOT_EXIST(id));
-            return false;
+        for (auto &relation : implied) {
+            unlink(relation.first, relation.second);
         }
-        poset &posetToBeAddedTo = posetToBeAddedToIterator->second;
-
-        ///Finding and setting the right values for the 3 variables declared below
-        poset_element_id firstElementId;
-        relations firstElementRelations, firstElementTransposedRelations;
-        FIND_RELATIONS_AND_ID(firstElementId, firstElementRelations, firstElementTransposedRelations, value1);
+        link(lower, upper);
+    }
 
-        ///Finding and setting the right values for the 3 variables declared below
-        poset_element_id secondElementId;
-        relations secondElementRelations, secondElementTransposedRelations;
-        FIND_RELATIONS_AND_ID(secondElementId, secondElementRelations, secondElementTransposedRelations, value2);
+    void hasse_diagram::remove_covering(poset_element_id lower, poset_element_id upper) {
+        indexBuilt.store(false, memory_order_relaxed);
 
-        if (firstElementRelations.find(secondElementId) != firstElementRelations.end()) {
-            DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " already exists");
+        unlink(lower, upper);
 
-            return false;
+        // Relations implied only by the removed one now need covering relations of their own.
+        for (poset_element_id belowLower : elements[lower].second) {
+            if (!search(belowLower, upper, false)) {
+                link(belowLower, upper);
+            }
+        }
+        for (poset_element_id aboveUpper : elements[upper].first) {
+            if (!search(lower, aboveUpper, false)) {
+                link(lower, aboveUpper);
+            }
         }
-        assert(secondElementTransposedRelations.find(firstElementId) == secondElementTransposedRelations.end());
+    }
 
-        if (firstElementTransposedRelations.find(secondElementId) != firstElementTransposedRelations.end()) {
-            DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " cannot be added");
+    /// Bit row: bit i is set iff the element is in relation with element i. Words of the row
+    /// belong to the arena of its poset, words past its length up to its capacity are zero.
+    struct relations {
+        relations_word *words = nullptr;
+        uint32_t length = 0;
+        uint32_t capacity = 0;
 
-            return false;
+        size_t size() const {
+            return length;
         }
-        assert(secondElementRelations.find(firstElementId) == secondElementRelations.end());
 
-        iterate_and_add_relations(firstElementTransposedRelations, posetToBeAddedTo, secondElementRelations, true);
-        iterate_and_add_relations(secondElementRelations, posetToBeAddedTo, firstElementTransposedRelations, false);
+        relations_word *data() {
+            return words;
+        }
 
-        DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " added");
+        const relations_word *data() const {
+            return words;
+        }
 
-        return true;
-    }
+        relations_word &operator[](size_t word) {
+            return words[word];
+        }
+
+        relations_word operator[](size_t word) const {
+            return words[word];
+        }
+    };
 
+    /// Rows of successors (first) and predecessors (second) of an element.
+    struct poset_relations {
+        relations first;
+        relations second;
+        /// Snapshots of this epoch or later see these rows.
+        relations_epoch epoch = 0;
+    };
 
-    bool poset_del(unsigned long id, char const *value1, char const *value2) {
-        DEBUG("(" << id << ", " << MAKE_STRING(value1) << ", " << MAKE_STRING(value2) << ")");
-        if (value1 == nullptr || value2 == nullptr) {
-            if (value1 == nullptr) {
-                DEBUG(": " << INVALID_VALUE(value1));
+    /*
+     * Memory of the rows of a poset. Rows are cut out of large chunks by bumping
+     * a pointer, and rows given back are kept by capacity to be reused. Everything
+     * is freed at once with the arena, when the poset is cleared or deleted and
+     * the snapshots taken of it are released.
+     *
+     * Rows are shared with the snapshots taken after they were written. A row
+     * which changes is copied first if a snapshot shares it, the old one is retired
+     * and reused once the last snapshot which could see it is released.
+     * Snapshots of the poset are taken and released with the poset locked for
+     * reading, so they never share or unshare rows while the poset changes them.
+     */
+    class relations_arena {
+    public:
+        relations_arena() = default;
+
+        relations_arena(const relations_arena &) = delete;
+        relations_arena &operator=(const relations_arena &) = delete;
+
+        /// Returns a zeroed row of at least the given number of words.
+        relations allocate(size_t words) {
+            relations row;
+            size_t sizeClass = size_class(words);
+            row.length = uint32_t(words);
+            row.capacity = uint32_t(class_words(sizeClass));
+
+            lock_guard<mutex> arenaLock(lock);
+            if (!freeRows[sizeClass].empty()) {
+                row.words = freeRows[sizeClass].back();
+                freeRows[sizeClass].pop_back();
+                fill(row.words, row.words + row.capacity, 0);
+
+                return row;
             }
-            if (value2 == nullptr) {
-                DEBUG(": " << INVALID_VALUE(value2));
+
+            if (chunkLeft < row.capacity) {
+                // Large rows get chunks of their own, so that little of a chunk is left unused.
+                size_t chunkWords = max(CHUNK_WORDS, size_t(row.capacity));
+                chunks.push_back(make_unique<relations_word[]>(chunkWords));
+                chunkNext = chunks.back().get();
+                chunkLeft = chunkWords;
             }
 
-            return false;
+            row.words = chunkNext;
+            chunkNext += row.capacity;
+            chunkLeft -= row.capacity;
+
+            return row;
         }
 
-        auto posetToBeRemovedFromIterator = posets().find(id);
-        if (posetToBeRemovedFromIterator == posets().end()) {
-            DEBUG(": " << POSET_NOT_EXIST(id));
+        /// Gives back a row which is not shared with any snapshot.
+        void deallocate(const relations &row) {
+            lock_guard<mutex> arenaLock(lock);
+            freeRows[size_class(row.capacity)].push_back(row.words);
+        }
 
-            return false;
+        /// Epoch of the rows written now.
+        relations_epoch epoch() const {
+            return currentEpoch.load(memory_order_relaxed);
         }
-        poset &posetToBeRemovedFrom = posetToBeRemovedFromIterator->second;
 
-        poset_element_id firstElementId = get_poset_element_id(id, value1);
-        if (firstElementId == INVALID_POSET_ELEMENT_ID) {
-            DEBUG(": poset " << id << ", " << ELEMENT_NOT_EXIST(value1));
+        /// True if a snapshot which is not released yet sees the rows of the given epoch.
+        bool shared(relations_epoch rowsEpoch) const {
+            return newestSharedEpoch.load(memory_order_relaxed) >= rowsEpoch;
+        }
 
-            return false;
+        /// Gives back the rows once no snapshot sees them.
+        void retire(const poset_relations &elementRelations) {
+            lock_guard<mutex> arenaLock(lock);
+            for (const relations *row : {&elementRelations.first, &elementRelations.second}) {
+                retiredRows.push_back({row->words, row->capacity, elementRelations.epoch,
+                                       newestSharedEpoch.load(memory_order_relaxed)});
+            }
         }
-        assert(posetToBeRemovedFrom.find(firstElementId) != posetToBeRemovedFrom.end());
 
-        poset_element_id secondElementId = get_poset_element_id(id, value2);
-        if (secondElementId == INVALID_POSET_ELEMENT_ID) {
-            DEBUG(": poset " << id << ", " << ELEMENT_NOT_EXIST(value2));
+        /// Starts sharing the rows written so far with a new snapshot, returns its epoch.
+        relations_epoch share() {
+            lock_guard<mutex> arenaLock(lock);
+            relations_epoch snapshotEpoch = currentEpoch.fetch_add(1, memory_order_relaxed);
+            sharedEpochs.insert(snapshotEpoch);
+            newestSharedEpoch.store(snapshotEpoch, memory_order_relaxed);
 
-            return false;
+            return snapshotEpoch;
         }
-        assert(posetToBeRemovedFrom.find(secondElementId) != posetToBeRemovedFrom.end());
 
-        //Every poset element must be in relation with itself
-        if (firstElementId == secondElementId) {
-            DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " cannot be deleted");
+        /// Ends sharing with the snapshot of the given epoch and reuses the rows no snapshot sees.
+        void unshare(relations_epoch snapshotEpoch) {
+            lock_guard<mutex> arenaLock(lock);
+            sharedEpochs.erase(sharedEpochs.find(snapshotEpoch));
+            newestSharedEpoch.store(sharedEpochs.empty() ? 0 : *sharedEpochs.rbegin(), memory_order_relaxed);
+
+            auto stillShared = [this](const retired_row &row) {
+                auto sharedEpoch = sharedEpochs.lower_bound(row.firstEpoch);
+                return sharedEpoch != sharedEpochs.end() && *sharedEpoch <= row.lastEpoch;
+            };
+            auto reusable = partition(retiredRows.begin(), retiredRows.end(), stillShared);
+            for (auto row = reusable; row != retiredRows.end(); row++) {
+                freeRows[size_class(row->capacity)].push_back(row->words);
+            }
+            retiredRows.erase(reusable, retiredRows.end());
+        }
 
-            return false;
+    private:
+        /// Row of the poset no longer, seen by the snapshots of the epochs from firstEpoch to lastEpoch.
+        struct retired_row {
+            relations_word *words;
+            uint32_t capacity;
+            relations_epoch firstEpoch;
+            relations_epoch lastEpoch;
+        };
+
+        static constexpr size_t CHUNK_WORDS = size_t(1) << 13;
+        static constexpr size_t SMALL_CLASSES = 8;
+
+        /*
+         * Rows get the words of the smallest size class fitting them: up to 8 words
+         * exactly, then 4 classes for each power of two. Finer classes than powers
+         * of two also keep rows OR-ed together from starting at the same offset
+         * of a page, which makes the processor stall on their loads and stores.
+         */
+        static size_t size_class(size_t words) {
+            if (words <= SMALL_CLASSES) {
+                return words == 0 ? 0 : words - 1;
+            }
+            size_t exponent = numeric_limits<unsigned long long>::digits - 1 - __builtin_clzll(words - 1);
+            size_t step = size_t(1) << (exponent - 2);
+
+            return SMALL_CLASSES + (exponent - 3) * 4 + (words - 1) / step - 4;
         }
 
-        poset_relations &firstElement = posetToBeRemovedFrom[firstElementId];
-        poset_relations &secondElement = posetToBeRemovedFrom[secondElementId];
+        static size_t class_words(size_t sizeClass) {
+            if (sizeClass < SMALL_CLASSES) {
+                return sizeClass + 1;
+            }
+            size_t exponent = (sizeClass - SMALL_CLASSES) / 4 + 3;
 
-        relations &firstElementRelations = firstElement.first;
-        relations &secondElementTransposedRelations = secondElement.second;
+            return ((sizeClass - SMALL_CLASSES) % 4 + 5) << (exponent - 2);
+        }
 
-        auto relationToBeRemovedIterator = firstElementRelations.find(secondElementId);
-        auto transposedRelationToBeRemovedIterator = secondElementTransposedRelations.find(firstElementId);
+        mutex lock;
+        vector<unique_ptr<relations_word[]>> chunks;
+        relations_word *chunkNext = nullptr;
+        size_t chunkLeft = 0;
+        array<vector<relations_word *>, SMALL_CLASSES + (numeric_limits<uint32_t>::digits - 2) * 4> freeRows;
+        vector<retired_row> retiredRows;
+        multiset<relations_epoch> sharedEpochs;
+        atomic<relations_epoch> currentEpoch{1};
+        atomic<relations_epoch> newestSharedEpoch{0};
+    };
 
-        if (relationToBeRemovedIterator == firstElementRelations.end()) {
-            DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " cannot be deleted");
+    /*
+     * Rows of a poset indexed by element id, removed elements have null rows.
+     * Copies share the arena and the rows, see relations_arena.
+     */
+    class poset {
+    public:
+        poset() : arena(make_shared<relations_arena>()) {}
 
-            return false;
+        size_t size() const {
+            return rows.size();
         }
-        assert(transposedRelationToBeRemovedIterator != secondElementTransposedRelations.end());
 
-        for (poset_element_id i : firstElementRelations) {
-            if (i == firstElementId || i == secondElementId) {
-                continue;
+        const poset_relations &operator[](poset_element_id elementId) const {
+            return rows[elementId];
+        }
+
+        /*
+         * Functions below change the rows. Assume that the poset is locked exclusively.
+         */
+        /// Adds rows of an element in relation with itself only. Assumes that the id
+        /// is free or follows all the used ids.
+        void insert(poset_element_id elementId) {
+            if (elementId == rows.size()) {
+                rows.emplace_back();
             }
+            assert(rows[elementId].first.data() == nullptr);
 
-            auto tmpIterator = posetToBeRemovedFrom.find(i);
-            relations tmpRelations = (tmpIterator->second).first;
-            if (tmpRelations.find(secondElementId) != tmpRelations.end()) {
-                DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " cannot be deleted");
+            size_t words = elementId / RELATIONS_WORD_BITS + 1;
+            poset_relations &elementRelations = rows[elementId];
+            elementRelations = {arena->allocate(words), arena->allocate(words), arena->epoch()};
 
-                return false;
-            }
+            relations_word ownBit = relations_word(1) << (elementId % RELATIONS_WORD_BITS);
+            elementRelations.first[words - 1] = ownBit;
+            elementRelations.second[words - 1] = ownBit;
         }
 
-        firstElementRelations.erase(relationToBeRemovedIterator);
-        secondElementTransposedRelations.erase(transposedRelationToBeRemovedIterator);
+        /// Adds rows of the given number of zero words for the next id.
+        poset_relations &append(size_t words) {
+            rows.push_back({arena->allocate(words), arena->allocate(words), arena->epoch()});
 
-        DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " deleted");
+            return rows.back();
+        }
 
-        return true;
-    }
+        void remove(poset_element_id elementId) {
+            release(rows[elementId]);
+            rows[elementId] = poset_relations();
+        }
 
-    bool poset_test(unsigned long id, char const *value1, char const *value2) {
-        DEBUG("(" << id << ", " << MAKE_STRING(value1) << ", " << MAKE_STRING(value2) << ")");
-        if (value1 == nullptr || value2 == nullptr) {
-            if (value1 == nullptr) {
-                DEBUG(": " << INVALID_VALUE(value1));
-            }
-            if (value2 == nullptr) {
-                DEBUG(": " << INVALID_VALUE(value2));
+        /// Returns rows of the element which can be changed, copies them first if they are shared.
+        poset_relations &mutable_relations(poset_element_id elementId) {
+            poset_relations &elementRelations = rows[elementId];
+            assert(elementRelations.first.data() != nullptr);
+
+            if (arena->shared(elementRelations.epoch)) {
+                poset_relations copied{copy(elementRelations.first), copy(elementRelations.second), arena->epoch()};
+                arena->retire(elementRelations);
+                elementRelations = copied;
             }
 
-            return false;
+            return elementRelations;
         }
 
-        if (posets().find(id) == posets().end()) {
-            DEBUG(": " << POSET_NOT_EXIST(id));
+        /// Makes a row of mutable_relations at least the given number of words long.
+        void extend(relations &row, size_t words) {
+            if (words <= row.capacity) {
+                row.length = uint32_t(max(size_t(row.length), words));
+                return;
+            }
 
-            return false;
+            relations extended = arena->allocate(words);
+            copy_n(row.data(), row.size(), extended.data());
+            arena->deallocate(row);
+            row = extended;
         }
-        poset posetToBeTested = posets()[id];
 
-        poset_element_id firstElementId = get_poset_element_id(id, value1);
-        if (firstElementId == INVALID_POSET_ELEMENT_ID) {
-            DEBUG(": poset " << id << ", " << ELEMENT_NOT_EXIST(value1));
+        /*
+         * Functions below share the rows with snapshots, with the poset locked
+         * for reading at least.
+         */
+        relations_epoch share() const {
+            return arena->share();
+        }
 
-            return false;
+        void unshare(relations_epoch snapshotEpoch) const {
+            arena->unshare(snapshotEpoch);
         }
 
-        poset_element_id secondElementId = get_poset_element_id(id, value2);
-        if (secondElementId == INVALID_POSET_ELEMENT_ID) {
-            DEBUG(": poset " << id << ", " << ELEMENT_NOT_EXIST(value2));
+    private:
+        relations copy(const relations &row) {
+            relations copied = arena->allocate(row.size());
+            copy_n(row.data(), row.size(), copied.data());
 
-            return false;
+            return copied;
         }
 
-        assert(posetToBeTested.find(firstElementId) != posetToBeTested.end());
-        poset_relations firstElement = posetToBeTested[firstElementId];
+        void release(const poset_relations &elementRelations) {
+            if (arena->shared(elementRelations.epoch)) {
+                arena->retire(elementRelations);
+            } else {
+                arena->deallocate(elementRelations.first);
+                arena->deallocate(elementRelations.second);
+            }
+        }
 
+        vector<poset_relations> rows;
+        shared_ptr<relations_arena> arena;
+    };
+
+    /// Everything kept for a single poset, guarded by its lock.
+    struct poset_state {
+        /// Poset loaded by poset_load and not changed since, elements and names are empty then.
+        shared_ptr<const poset_image> image;
+        poset elements;
+        /// Invariant: the element is present in poset iff some id belongs to its name.
+        /// Shared with the snapshots taken before it changes.
+        shared_ptr<name_to_element_id> names = make_shared<name_to_element_id>();
+        element_names elementNames;
+        /// Generations indexed by element id, ids of removed elements are reused before new ones.
+        vector<element_generation> elementGenerations;
+        vector<poset_element_id> freeElementIds;
+        /// Generation of the ids given out since the poset was last cleared or compacted.
+        element_generation firstGeneration = 0;
+        /// Kept instead of elements by the posets created with poset_new_sparse.
+        /// Shared with the snapshots taken before it changes.
+        shared_ptr<hasse_diagram> hasse;
+        shared_mutex lock;
+    };
+
+    /// Rows and names of a poset at the moment the snapshot was taken, never changed.
+    struct poset_snapshot_state {
+        poset_id posetId{};
+        poset elements;
+        relations_epoch epoch{};
+        shared_ptr<const name_to_element_id> names;
+        shared_ptr<const hasse_diagram> hasse;
+    };
+
+    /// Posets whose ids fall into the shard. The lock guards the map, not the posets.
+    using poset_registry_shard = pair<shared_mutex, unordered_map<poset_id, poset_state>>;
+
+    ///Structure mapping poset_id to poset, split into independently locked shards.
+    array<poset_registry_shard, POSET_REGISTRY_SHARDS> &posetRegistry() {
+        static array<poset_registry_shard, POSET_REGISTRY_SHARDS> registry;
+        return registry;
+    }
 
-        assert(posetToBeTested.find(secondElementId) != posetToBeTested.end());
+    poset_registry_shard &registry_shard(poset_id id) {
+        return posetRegistry()[id % POSET_REGISTRY_SHARDS];
+    }
 
-        relations firstElementRelations = firstElement.first;
+    void materialize_image(poset_state &state);
 
-        if (firstElementRelations.find(secondElementId) != firstElementRelations.end()) {
-            DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " exists");
+    /*
+     * Finds the poset with the given id and keeps it locked, shared or exclusively
+     * depending on PosetLock. The registry shard stays locked as well, so the poset
+     * cannot be deleted meanwhile. Converts to false if there is no such poset.
+     * Writers never see a mapped image, it is replaced by ordinary rows first.
+     */
+    template<typename PosetLock>
+    class poset_access {
+    public:
+        explicit poset_access(poset_id id) : shardLock(registry_shard(id).first) {
+            auto &shardPosets = registry_shard(id).second;
+            auto posetIterator = shardPosets.find(id);
+
+            if (posetIterator != shardPosets.end()) {
+                state = &posetIterator->second;
+                posetLock = PosetLock(state->lock);
+
+                if constexpr (is_same<PosetLock, unique_lock<shared_mutex>>::value) {
+                    if (state->image != nullptr) {
+                        materialize_image(*state);
+                    }
+                }
+            }
+        }
 
-            return true;
-        } else {
-            DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " does not exist");
+        explicit operator bool() const {
+            return state != nullptr;
+        }
 
-            return false;
+        poset_state &operator*() const {
+            return *state;
         }
-    }
 
-    void poset_clear(unsigned long id) {
-        DEBUG("(" << id << ")");
+        poset_state *operator->() const {
+            return state;
+        }
 
-        if (posets().find(id) == posets().end()) {
-            DEBUG(": " << POSET_NOT_EXIST(id));
+    private:
+        shared_lock<shared_mutex> shardLock;
+        poset_state *state = nullptr;
+        PosetLock posetLock;
+    };
 
-            return;
-        }
+    using poset_reader = poset_access<shared_lock<shared_mutex>>;
+    using poset_writer = poset_access<unique_lock<shared_mutex>>;
 
-        assert(posetIdToMapOfNames().find(id) != posetIdToMapOfNames().end());
+    ///Lock guarding internedNames(), nameToNameId() and freeNameIds(), taken after a poset lock.
+    shared_mutex &internedNamesLock() {
+        static shared_mutex lock;
+        return lock;
+    }
 
-        unordered_map<string, poset_element_id> &namesToBeCleared = posetIdToMapOfNames()[id];
-        poset &posetToBeCleared = posets()[id];
+    ///Interned names indexed by name_id, deque keeps them in place when it grows.
+    deque<interned_name> &internedNames() {
+        static deque<interned_name> names;
+        return names;
+    }
 
-        namesToBeCleared.clear();
-        posetToBeCleared.clear();
+    ///Structure mapping interned name to its id.
+    name_to_name_id &nameToNameId() {
+        static name_to_name_id nameToNameId;
+        return nameToNameId;
+    }
 
-        DEBUG(": poset " << id << " cleared");
+    ///Ids of released names, reused before new ones.
+    vector<name_id> &freeNameIds() {
+        static vector<name_id> freeNameIds;
+        return freeNameIds;
     }
-}
 
+    ///Structure mapping snapshot_id to snapshot.
+    unordered_map<snapshot_id, poset_snapshot_state> &snapshots() {
+        static unordered_map<snapshot_id, poset_snapshot_state> snapshots;
+        return snapshots;
+    }
+
+    ///Lock guarding snapshots(), never held together with a poset lock.
+    shared_mutex &snapshotsLock() {
+        static shared_mutex lock;
+        return lock;
+    }
+
+    ///Ids of names no longer used by any poset, but possibly used by a snapshot.
+    vector<name_id> &retiredNameIds() {
+        static vector<name_id> retiredNameIds;
+        return retiredNameIds;
+    }
+
+    using trace_operation = jnp1::poset_operation;
+    using trace_outcome = jnp1::poset_outcome;
 
+#define POSET_FUNCTION_NAME(name) "poset_" #name,
+#define POSET_NAME(name) #name,
+    const char *const TRACE_OPERATION_NAMES[] = {POSET_OPERATIONS(POSET_FUNCTION_NAME)};
+    const char *const TRACE_OUTCOME_NAMES[] = {POSET_OUTCOMES(POSET_NAME)};
+#undef POSET_FUNCTION_NAME
+#undef POSET_NAME
+
+    /*
+     * Ring buffer keeping the last calls of the library. Writers never wait: each of
+     * them takes the next slot with a single atomic increment. A slot is guarded
+     * by its sequence number like a seqlock: odd while the record is written, so
+     * that readers skip records which are being overwritten.
+     */
+    class trace_buffer {
+    public:
+        /// Capacity is a power of two.
+        explicit trace_buffer(size_t capacity) : slots(capacity) {}
+
+        void record(trace_operation operation, trace_outcome outcome, uint64_t id, uint64_t latency) {
+            uint64_t number = nextNumber.fetch_add(1, memory_order_relaxed);
+            trace_slot &slot = slots[number & (slots.size() - 1)];
+
+            // A reader which sees any of the fields stored below sees the odd sequence number as well.
+            slot.sequence.store(2 * number + 1, memory_order_relaxed);
+            slot.id.store(id, memory_order_release);
+            slot.latency.store(latency, memory_order_release);
+            slot.kind.store(uint16_t(operation) | uint16_t(outcome) << 8, memory_order_release);
+            slot.sequence.store(2 * number + 2, memory_order_release);
+        }
+
+        /*
+         * Calls function(number, operation, outcome, id, latency) for the records
+         * still kept, oldest first.
+         */
+        template<typename Function>
+        void for_each_record(Function function) const {
+            uint64_t end = nextNumber.load(memory_order_acquire);
+            uint64_t begin = end > slots.size() ? end - slots.size() : 0;
+
+            for (uint64_t number = begin; number < end; number++) {
+                const trace_slot &slot = slots[number & (slots.size() - 1)];
+
+                uint64_t sequence = slot.sequence.load(memory_order_acquire);
+                uint64_t id = slot.id.load(memory_order_acquire);
+                uint64_t latency = slot.latency.load(memory_order_acquire);
+                uint16_t kind = slot.kind.load(memory_order_acquire);
+
+                if (sequence == 2 * number + 2 && slot.sequence.load(memory_order_relaxed) == sequence) {
+                    function(number, trace_operation(kind & 0xff), trace_outcome(kind >> 8), id, latency);
+                }
+            }
+        }
+
+    private:
+        struct trace_slot {
+            atomic<uint64_t> sequence{0};
+            atomic<uint64_t> id{0};
+            atomic<uint64_t> latency{0};
+            atomic<uint16_t> kind{0};
+        };
+
+        vector<trace_slot> slots;
+        atomic<uint64_t> nextNumber{0};
+    };
+
+    ///Buffer the calls are traced to, nullptr if tracing is off.
+    atomic<trace_buffer *> activeTraceBuffer(nullptr);
+
+    ///Lock guarding traceBuffers(), taken by poset_trace_start and poset_trace_dump only.
+    mutex &traceBuffersLock() {
+        static mutex lock;
+        return lock;
+    }
+
+    ///Buffers of all the traces started, the last one is dumped. They are never freed,
+    ///as a call which started before tracing stopped may still record to its buffer.
+    vector<unique_ptr<trace_buffer>> &traceBuffers() {
+        static vector<unique_ptr<trace_buffer>> buffers;
+        return buffers;
+    }
+
+    ///Latency histograms have 2^LATENCY_SUB_BUCKET_BITS buckets for each power of two.
+    constexpr unsigned LATENCY_SUB_BUCKET_BITS = 3;
+    constexpr uint64_t LATENCY_SUB_BUCKETS = uint64_t(1) << LATENCY_SUB_BUCKET_BITS;
+
+    /*
+     * Returns the histogram bucket of a latency: latencies below 2 * LATENCY_SUB_BUCKETS
+     * have buckets of their own, each next power of two is split into LATENCY_SUB_BUCKETS
+     * buckets of equal width. Latencies too long for the histogram fall into its last bucket.
+     */
+    size_t latency_bucket(uint64_t latency) {
+        if (latency < 2 * LATENCY_SUB_BUCKETS) {
+            return latency;
+        }
+
+        unsigned exponent = 63 - __builtin_clzll(latency);
+        size_t bucket = (exponent - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS
+                        + (latency >> (exponent - LATENCY_SUB_BUCKET_BITS)) - LATENCY_SUB_BUCKETS;
+
+        return min(bucket, size_t(POSET_LATENCY_BUCKETS - 1));
+    }
+
+    ///Counters of a single operation.
+    struct operation_metrics {
+        array<atomic<uint64_t>, jnp1::POSET_OUTCOME_COUNT> outcomes;
+        atomic<uint64_t> latencyTotal;
+        array<atomic<uint64_t>, POSET_LATENCY_BUCKETS> latency;
+    };
+
+    /*
+     * Metrics are counted in METRICS_STRIPES copies, each thread counts in one of them,
+     * so that threads calling the library at once rarely write to the same cache lines.
+     */
+    constexpr size_t METRICS_STRIPES = 8;
+
+    using metrics_stripe = array<operation_metrics, jnp1::POSET_OPERATION_COUNT>;
+
+    ///Counters of the metrics, zero-initialized as static storage.
+    array<metrics_stripe, METRICS_STRIPES> metricsStripes;
+
+    ///Whether the calls are counted by the metrics.
+    atomic<bool> metricsEnabled(false);
+
+    atomic<size_t> nextMetricsStripe(0);
+
+    ///Counts a call which ended with outcome after latency nanoseconds.
+    void count_call(trace_operation operation, trace_outcome outcome, uint64_t latency) {
+        thread_local const size_t stripe = nextMetricsStripe.fetch_add(1, memory_order_relaxed) % METRICS_STRIPES;
+
+        operation_metrics &metrics = metricsStripes[stripe][operation];
+        metrics.outcomes[outcome].fetch_add(1, memory_order_relaxed);
+        metrics.latencyTotal.fetch_add(latency, memory_order_relaxed);
+        metrics.latency[latency_bucket(latency)].fetch_add(1, memory_order_relaxed);
+    }
+
+    /*
+     * Records a call of the library when it returns: to the trace the operation, id
+     * of the poset or snapshot, the outcome and the time the call took, to the metrics
+     * the operation, the outcome and the time. Costs two atomic loads if both
+     * tracing and metrics are off.
+     */
+    class trace_scope {
+    public:
+        trace_scope(trace_operation operation, uint64_t id) :
+                buffer(activeTraceBuffer.load(memory_order_acquire)),
+                counted(metricsEnabled.load(memory_order_relaxed)), operation(operation), id(id) {
+            if (buffer != nullptr || counted) {
+                start = chrono::steady_clock::now();
+            }
+        }
+
+        trace_scope(const trace_scope &) = delete;
+        trace_scope &operator=(const trace_scope &) = delete;
+
+        ~trace_scope() {
+            if (buffer == nullptr && !counted) {
+                return;
+            }
+
+            auto latency = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+            if (buffer != nullptr) {
+                buffer->record(operation, outcome, id, uint64_t(latency.count()));
+            }
+            if (counted) {
+                count_call(operation, outcome, uint64_t(latency.count()));
+            }
+        }
+
+        void outcome_is(trace_outcome callOutcome) {
+            outcome = callOutcome;
+        }
+
+        /// For the calls which find out the id while running.
+        void id_is(uint64_t callId) {
+            id = callId;
+        }
+
+    private:
+        trace_buffer *buffer;
+        bool counted;
+        trace_operation operation;
+        trace_outcome outcome = jnp1::poset_outcome_done;
+        uint64_t id;
+        chrono::steady_clock::time_point start;
+    };
+
+    atomic<poset_id> nextPosetId(INITIAL_POSET_ID);
+    atomic<snapshot_id> nextSnapshotId(INITIAL_SNAPSHOT_ID);
+    ///Number of snapshots not released yet, guarded by internedNamesLock().
+    size_t liveSnapshotCount = 0;
+
+    /*
+     * Returns id of the interned name or INVALID_NAME_ID if the name
+     * is not used by any poset. Does not allocate memory.
+     * Assumes that internedNamesLock() is held.
+     */
+    name_id find_name_id(char const *value) {
+        auto nameIterator = nameToNameId().find(value);
+        if (nameIterator == nameToNameId().end()) {
+            return INVALID_NAME_ID;
+        }
+
+        return nameIterator->second;
+    }
+
+    /*
+     * Interns the name for one more element and returns its id.
+     */
+    name_id intern_name(char const *value) {
+        unique_lock<shared_mutex> namesLock(internedNamesLock());
+
+        name_id nameId = find_name_id(value);
+
+        if (nameId == INVALID_NAME_ID) {
+            if (freeNameIds().empty()) {
+                assert(internedNames().size() < INVALID_NAME_ID);
+
+                nameId = name_id(internedNames().size());
+                internedNames().emplace_back(value, 0);
+            } else {
+                nameId = freeNameIds().back();
+                freeNameIds().pop_back();
+                internedNames()[nameId].first = value;
+            }
+
+            nameToNameId()[internedNames()[nameId].first] = nameId;
+        }
+
+        internedNames()[nameId].second++;
+
+        return nameId;
+    }
+
+    /*
+     * Forgets the name, so that its id can be reused.
+     * Assumes that internedNamesLock() is held exclusively.
+     */
+    void forget_name(name_id nameId) {
+        interned_name &name = internedNames()[nameId];
+        assert(name.second == 0);
+
+        nameToNameId().erase(name.first);
+        name.first.clear();
+        name.first.shrink_to_fit();
+        freeNameIds().push_back(nameId);
+    }
+
+    /*
+     * Releases the name of one element, forgets the name when no element uses it.
+     * While there are snapshots, the name is only retired, as a snapshot may still
+     * look it up and its id must not denote another name meanwhile.
+     * Assumes that internedNamesLock() is held exclusively.
+     */
+    void release_name(name_id nameId) {
+        interned_name &name = internedNames()[nameId];
+        assert(name.second > 0);
+
+        if (--name.second == 0) {
+            if (liveSnapshotCount > 0) {
+                retiredNameIds().push_back(nameId);
+            } else {
+                forget_name(nameId);
+            }
+        }
+    }
+
+    /*
+     * Forgets retired names which were not interned again.
+     * Assumes that internedNamesLock() is held exclusively and there are no snapshots.
+     */
+    void forget_retired_names() {
+        vector<name_id> &retired = retiredNameIds();
+        sort(retired.begin(), retired.end());
+        retired.erase(unique(retired.begin(), retired.end()), retired.end());
+
+        for (name_id nameId : retired) {
+            if (internedNames()[nameId].second == 0) {
+                forget_name(nameId);
+            }
+        }
+
+        retired.clear();
+    }
+
+    /*
+     * Releases names of all the elements of the poset.
+     */
+    void release_names(const name_to_element_id &names) {
+        unique_lock<shared_mutex> namesLock(internedNamesLock());
+
+        for (auto &nameAndElement : names) {
+            release_name(nameAndElement.first);
+        }
+    }
+
+    /*
+     * Returns id of the element with the given name or INVALID_POSET_ELEMENT_ID
+     * if there is no such element or the name is NULL. Does not allocate memory.
+     */
+    poset_element_id find_element_id(const name_to_element_id &names, char const *value) {
+        if (value == nullptr) {
+            return INVALID_POSET_ELEMENT_ID;
+        }
+
+        // Held until the name is found in the poset, so that its id cannot be reused meanwhile.
+        shared_lock<shared_mutex> namesLock(internedNamesLock());
+
+        name_id nameId = find_name_id(value);
+        if (nameId == INVALID_NAME_ID) {
+            return INVALID_POSET_ELEMENT_ID;
+        }
+
+        auto nameToIdIterator = names.find(nameId);
+        if (nameToIdIterator == names.end()) {
+            return INVALID_POSET_ELEMENT_ID;
+        }
+
+        return nameToIdIterator->second;
+    }
+
+    /*
+     * Returns the name of the element, assumes that the element exists.
+     */
+    string_view element_name(const poset_state &state, poset_element_id elementId) {
+        if (state.image != nullptr) {
+            return state.image->name(elementId);
+        }
+
+        shared_lock<shared_mutex> namesLock(internedNamesLock());
+
+        return internedNames()[state.elementNames[elementId]].first;
+    }
+
+    /*
+     * Returns names of the poset which can be changed, copies them first if they
+     * are shared with a snapshot. Assumes that the poset is locked exclusively.
+     */
+    name_to_element_id &mutable_names(poset_state &state) {
+        if (state.names.use_count() > 1) {
+            state.names = make_shared<name_to_element_id>(*state.names);
+        }
+
+        return *state.names;
+    }
+
+    /*
+     * Returns the Hasse diagram of a sparse poset which can be changed, copies it
+     * first if it is shared with a snapshot. Assumes that the poset is locked exclusively.
+     */
+    hasse_diagram &mutable_hasse(poset_state &state) {
+        assert(state.hasse != nullptr);
+
+        if (state.hasse.use_count() > 1) {
+            state.hasse = make_shared<hasse_diagram>(*state.hasse);
+        }
+
+        return *state.hasse;
+    }
+
+    /*
+     * If the parametr transpose has value true, returns the first element of
+     * posetRelations, otherwise returns the second element.
+     */
+    inline relations &getRelations(poset_relations &posetRelations, bool transpose) {
+        if (transpose) {
+            return posetRelations.first;
+        }
+
+        return posetRelations.second;
+    }
+
+    /*
+     * Returns true if the bit of element i is set in the given row.
+     */
+    inline bool test_relation(const relations &row, poset_element_id i) {
+        size_t word = i / RELATIONS_WORD_BITS;
+
+        return word < row.size() && ((row[word] >> (i % RELATIONS_WORD_BITS)) & 1);
+    }
+
+    /*
+     * Sets the bit of element i in the given row, assumes that the row is long enough.
+     */
+    inline void set_relation(relations_word *row, poset_element_id i) {
+        row[i / RELATIONS_WORD_BITS] |= relations_word(1) << (i % RELATIONS_WORD_BITS);
+    }
+
+    /*
+     * Clears the bit of element i in the given row.
+     */
+    inline void reset_relation(relations &row, poset_element_id i) {
+        size_t word = i / RELATIONS_WORD_BITS;
+        if (word < row.size()) {
+            row[word] &= ~(relations_word(1) << (i % RELATIONS_WORD_BITS));
+        }
+    }
+
+    /// Kernel computing destination[i] |= source[i] for i < count.
+    using or_words_kernel = void (*)(relations_word *destination, const relations_word *source, size_t count);
+
+    void or_words_scalar(relations_word *destination, const relations_word *source, size_t count) {
+        for (size_t word = 0; word < count; word++) {
+            destination[word] |= source[word];
+        }
+    }
+
+#ifdef POSET_X86_KERNELS
+    __attribute__((target("sse2")))
+    void or_words_sse2(relations_word *destination, const relations_word *source, size_t count) {
+        const size_t wordsPerVector = sizeof(__m128i) / sizeof(relations_word);
+
+        size_t word = 0;
+        for (; word + wordsPerVector <= count; word += wordsPerVector) {
+            auto *to = reinterpret_cast<__m128i *>(destination + word);
+            auto *from = reinterpret_cast<const __m128i *>(source + word);
+            _mm_storeu_si128(to, _mm_or_si128(_mm_loadu_si128(to), _mm_loadu_si128(from)));
+        }
+
+        or_words_scalar(destination + word, source + word, count - word);
+    }
+
+    __attribute__((target("avx2")))
+    void or_words_avx2(relations_word *destination, const relations_word *source, size_t count) {
+        const size_t wordsPerVector = sizeof(__m256i) / sizeof(relations_word);
+
+        size_t word = 0;
+        for (; word + wordsPerVector <= count; word += wordsPerVector) {
+            auto *to = reinterpret_cast<__m256i *>(destination + word);
+            auto *from = reinterpret_cast<const __m256i *>(source + word);
+            _mm256_storeu_si256(to, _mm256_or_si256(_mm256_loadu_si256(to), _mm256_loadu_si256(from)));
+        }
+
+        or_words_scalar(destination + word, source + word, count - word);
+    }
+#endif
+
+    /*
+     * Chooses the widest kernel supported by the processor. The choice can be
+     * forced with the POSET_OR_KERNEL environment variable (scalar, sse2 or avx2),
+     * which is used to compare the kernels.
+     */
+    or_words_kernel select_or_words_kernel() {
+        const char *forced = getenv("POSET_OR_KERNEL");
+        if (forced != nullptr && strcmp(forced, "scalar") == 0) {
+            return or_words_scalar;
+        }
+
+#ifdef POSET_X86_KERNELS
+        __builtin_cpu_init();
+        bool avx2 = __builtin_cpu_supports("avx2");
+        bool sse2 = __builtin_cpu_supports("sse2");
+
+        if (forced != nullptr && strcmp(forced, "sse2") == 0) {
+            return sse2 ? or_words_sse2 : or_words_scalar;
+        }
+        if (avx2) {
+            return or_words_avx2;
+        }
+        if (sse2) {
+            return or_words_sse2;
+        }
+#endif
+
+        return or_words_scalar;
+    }
+
+    /*
+     * Adds all the relations of source to destination, a row of mutable_relations
+     * of the poset, using the selected kernel.
+     */
+    inline void or_relations(poset &owner, relations &destination, const relations &source) {
+        static const or_words_kernel orWords = select_or_words_kernel();
+
+        if (destination.size() < source.size()) {
+            owner.extend(destination, source.size());
+        }
+
+        orWords(destination.data(), source.data(), source.size());
+    }
+
+    /*
+     * Calls predicate for ids of the consecutive elements set in row, stops
+     * and returns true as soon as the predicate returns true.
+     */
+    template<typename Predicate>
+    bool any_relation(const relations_word *row, size_t words, Predicate predicate) {
+        for (size_t word = 0; word < words; word++) {
+            for (relations_word bits = row[word]; bits != 0; bits &= bits - 1) {
+                auto i = poset_element_id(word * RELATIONS_WORD_BITS + __builtin_ctzll(bits));
+                if (predicate(i)) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    template<typename Predicate>
+    bool any_relation(const relations &row, Predicate predicate) {
+        return any_relation(row.data(), row.size(), predicate);
+    }
+
+    /*
+     * Calls function for ids of all the elements set in row.
+     */
+    template<typename Function>
+    void for_each_relation(const relations &row, Function function) {
+        any_relation(row, [&function](poset_element_id i) {
+            function(i);
+            return false;
+        });
+    }
+
+    /*
+     * Returns true if some element other than first and second is set in both rows.
+     */
+    bool rows_intersect(const relations &row1, const relations &row2, poset_element_id first, poset_element_id second) {
+        size_t words = min(row1.size(), row2.size());
+
+        for (size_t word = 0; word < words; word++) {
+            relations_word common = row1[word] & row2[word];
+            for (poset_element_id i : {first, second}) {
+                if (i / RELATIONS_WORD_BITS == word) {
+                    common &= ~(relations_word(1) << (i % RELATIONS_WORD_BITS));
+                }
+            }
+
+            if (common != 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*
+     * Iterates over relations of the elements of toIterate and removes the
+     * element with the given id from those relations.
+     */
+    void iterate_and_remove(poset_element_id id, const relations &toIterate, poset &posetRemoveFrom, bool transpose) {
+        for_each_relation(toIterate, [&](poset_element_id i) {
+            assert(i < posetRemoveFrom.size());
+
+            if (i == id) {
+                return;
+            }
+
+            relations &tmpRelations = getRelations(posetRemoveFrom.mutable_relations(i), transpose);
+            assert(test_relation(tmpRelations, id));
+
+            reset_relation(tmpRelations, id);
+        });
+    }
+
+    /*
+     * Adds the elements of relationsToBeAdded to relationsToBeAddedTo so that the
+     * relations remain trasnitive.
+     */
+    void iterate_and_add_relations(const relations &relationsToBeAdded, poset &posetToBeAddedTo,
+                                   const relations &relationsToBeAddedTo, bool transpose) {
+        for_each_relation(relationsToBeAdded, [&](poset_element_id i) {
+            assert(i < posetToBeAddedTo.size());
+
+            or_relations(posetToBeAddedTo, getRelations(posetToBeAddedTo.mutable_relations(i), transpose),
+                         relationsToBeAddedTo);
+        });
+    }
+
+    /*
+     * Extends the relation so that the first element precedes the second one
+     * and the relation remains transitive. Assumes that the elements are
+     * not in relation.
+     */
+    void add_relation(poset &posetToBeAddedTo, poset_element_id firstElementId, poset_element_id secondElementId) {
+        // Neither row is changed below, as the elements are not in relation. Their words
+        // stay in place while the other rows are copied or extended.
+        const relations firstElementTransposedRelations = posetToBeAddedTo[firstElementId].second;
+        const relations secondElementRelations = posetToBeAddedTo[secondElementId].first;
+
+        iterate_and_add_relations(firstElementTransposedRelations, posetToBeAddedTo, secondElementRelations, true);
+        iterate_and_add_relations(secondElementRelations, posetToBeAddedTo, firstElementTransposedRelations, false);
+    }
+
+    /*
+     * Extends the relation of the poset, sparse or not, so that the first element
+     * precedes the second one. Assumes that the elements are not in relation.
+     */
+    void extend_relation(poset_state &state, poset_element_id firstElementId, poset_element_id secondElementId) {
+        if (state.hasse != nullptr) {
+            mutable_hasse(state).add(firstElementId, secondElementId);
+        } else {
+            add_relation(state.elements, firstElementId, secondElementId);
+        }
+    }
+
+    /*
+     * Removes element's id from the names of the poset and releases its name.
+     * Is called in purpose to preserve the invariant, that
+     * the element is present in poset iff some id belongs to
+     * its name and poset. The id is freed, with a new generation
+     * so that handles of the removed element are not valid anymore.
+     */
+    void remove_element_id(poset_state &state, poset_element_id elementId) {
+        name_id &nameId = state.elementNames[elementId];
+
+        name_to_element_id &names = mutable_names(state);
+        auto mapIterator = names.find(nameId);
+        names.erase(mapIterator);
+
+        state.elementGenerations[elementId]++;
+        state.freeElementIds.push_back(elementId);
+
+        unique_lock<shared_mutex> namesLock(internedNamesLock());
+        release_name(nameId);
+        nameId = INVALID_NAME_ID;
+    }
+
+    /*
+     * Returns an id for a new element of the poset, reusing a freed one if possible.
+     */
+    poset_element_id allocate_element_id(poset_state &state) {
+        if (!state.freeElementIds.empty()) {
+            poset_element_id elementId = state.freeElementIds.back();
+            state.freeElementIds.pop_back();
+
+            return elementId;
+        }
+
+        assert(state.elementNames.size() < INVALID_POSET_ELEMENT_ID);
+
+        state.elementNames.push_back(INVALID_NAME_ID);
+        state.elementGenerations.push_back(state.firstGeneration);
+
+        return poset_element_id(state.elementNames.size() - 1);
+    }
+
+    /*
+     * Returns a generation newer than all the generations given out by the poset.
+     */
+    element_generation next_generation(const poset_state &state) {
+        element_generation generation = state.firstGeneration;
+        for (element_generation elementGeneration : state.elementGenerations) {
+            generation = max(generation, elementGeneration);
+        }
+
+        return generation + 1;
+    }
+
+    /*
+     * Functions below read the poset whether it is a mapped image or not.
+     */
+    size_t element_count(const poset_state &state) {
+        return state.image != nullptr ? state.image->size() : state.names->size();
+    }
+
+    poset_element_id find_element_id(const poset_state &state, char const *value) {
+        if (state.image != nullptr) {
+            return value == nullptr ? INVALID_POSET_ELEMENT_ID : state.image->find(value);
+        }
+
+        return find_element_id(*state.names, value);
+    }
+
+    element_generation element_generation_of(const poset_state &state, poset_element_id elementId) {
+        return state.image != nullptr ? state.firstGeneration : state.elementGenerations[elementId];
+    }
+
+    poset_element_handle element_handle(const poset_state &state, poset_element_id elementId) {
+        return poset_element_handle(element_generation_of(state, elementId)) << HANDLE_GENERATION_SHIFT
+               | (poset_element_handle(elementId) + 1);
+    }
+
+    poset_element_id find_element_id(const poset_state &state, poset_element_handle handle) {
+        // An invalid handle gives INVALID_POSET_ELEMENT_ID, which is out of range.
+        auto elementId = poset_element_id(handle - 1);
+        auto generation = element_generation(handle >> HANDLE_GENERATION_SHIFT);
+
+        bool live = state.image != nullptr ? elementId < state.image->size()
+                                           : elementId < state.elementNames.size()
+                                             && state.elementNames[elementId] != INVALID_NAME_ID;
+        if (!live || element_generation_of(state, elementId) != generation) {
+            return INVALID_POSET_ELEMENT_ID;
+        }
+
+        return elementId;
+    }
+
+    /*
+     * Writers pass false as buildIndex, so that a sparse poset does not
+     * rebuild its index which the change is going to make stale again.
+     */
+    bool in_relation(const poset_state &state, poset_element_id firstElementId, poset_element_id secondElementId,
+                     bool buildIndex = true) {
+        if (state.image != nullptr) {
+            return state.image->test(firstElementId, secondElementId);
+        }
+        if (state.hasse != nullptr) {
+            return state.hasse->reaches(firstElementId, secondElementId, buildIndex);
+        }
+
+        return test_relation(state.elements[firstElementId].first, secondElementId);
+    }
+
+    /*
+     * Returns the name of the element terminated by '\0', assumes that the element
+     * exists. The name stays in place while the poset is locked.
+     */
+    char const *element_c_name(const poset_state &state, poset_element_id elementId) {
+        if (state.image != nullptr) {
+            return state.image->name(elementId).data();
+        }
+
+        shared_lock<shared_mutex> namesLock(internedNamesLock());
+
+        return internedNames()[state.elementNames[elementId]].first.c_str();
+    }
+
+    /*
+     * Calls function for ids of all the elements of the poset.
+     */
+    template<typename Function>
+    void for_each_element(const poset_state &state, Function function) {
+        if (state.image != nullptr) {
+            for (poset_element_id i = 0; i < state.image->size(); i++) {
+                function(i);
+            }
+            return;
+        }
+
+        for (poset_element_id i = 0; i < state.elementNames.size(); i++) {
+            if (state.elementNames[i] != INVALID_NAME_ID) {
+                function(i);
+            }
+        }
+    }
+
+    /*
+     * Returns the row of successors, or predecessors if transpose is true,
+     * of the element of a poset which is not sparse, and its length in words.
+     */
+    pair<const relations_word *, size_t> element_row(const poset_state &state, poset_element_id elementId,
+                                                     bool transpose) {
+        if (state.image != nullptr) {
+            return {transpose ? state.image->predecessors(elementId) : state.image->successors(elementId),
+                    state.image->row_words()};
+        }
+
+        const relations &row = transpose ? state.elements[elementId].second : state.elements[elementId].first;
+        return {row.data(), row.size()};
+    }
+
+    /*
+     * Calls function for the element and all the elements it precedes, or all the
+     * elements preceding it if transpose is true.
+     */
+    template<typename Function>
+    void for_each_related(const poset_state &state, poset_element_id elementId, bool transpose, Function function) {
+        if (state.hasse != nullptr) {
+            state.hasse->for_each_reachable(elementId, transpose, function);
+            return;
+        }
+
+        auto row = element_row(state, elementId, transpose);
+        any_relation(row.first, row.second, [&function](poset_element_id i) {
+            function(i);
+            return false;
+        });
+    }
+
+    /*
+     * Returns true if no element other than the given one precedes it,
+     * or follows it if transpose is false.
+     */
+    bool is_extreme(const poset_state &state, poset_element_id elementId, bool transpose) {
+        if (state.hasse != nullptr) {
+            return state.hasse->neighbours(elementId, transpose).empty();
+        }
+
+        auto row = element_row(state, elementId, transpose);
+        return !any_relation(row.first, row.second, [elementId](poset_element_id i) {
+            return i != elementId;
+        });
+    }
+
+    /*
+     * Returns ids of all the elements of the poset, each of them following
+     * all the elements preceding it.
+     */
+    vector<poset_element_id> linear_extension(const poset_state &state) {
+        vector<poset_element_id> order;
+        for_each_element(state, [&order](poset_element_id i) {
+            order.push_back(i);
+        });
+
+        if (state.hasse != nullptr) {
+            // Kahn's algorithm: an element is taken once all the elements it covers are.
+            vector<size_t> coveredLeft(state.elementNames.size());
+            vector<poset_element_id> ready;
+            for (poset_element_id i : order) {
+                coveredLeft[i] = state.hasse->neighbours(i, true).size();
+                if (coveredLeft[i] == 0) {
+                    ready.push_back(i);
+                }
+            }
+
+            order.clear();
+            while (!ready.empty()) {
+                poset_element_id current = ready.back();
+                ready.pop_back();
+                order.push_back(current);
+
+                for (poset_element_id next : state.hasse->neighbours(current, false)) {
+                    if (--coveredLeft[next] == 0) {
+                        ready.push_back(next);
+                    }
+                }
+            }
+
+            return order;
+        }
+
+        // Rows hold the whole relation, so an element is preceded by more elements than
+        // any element preceding it. Sorting by the number of predecessors is enough.
+        size_t idCount = state.image != nullptr ? state.image->size() : state.elementNames.size();
+        vector<size_t> predecessorCount(idCount);
+        for (poset_element_id i : order) {
+            auto row = element_row(state, i, true);
+            for (size_t word = 0; word < row.second; word++) {
+                predecessorCount[i] += __builtin_popcountll(row.first[word]);
+            }
+        }
+
+        sort(order.begin(), order.end(), [&predecessorCount](poset_element_id i, poset_element_id j) {
+            return predecessorCount[i] < predecessorCount[j];
+        });
+
+        return order;
+    }
+
+    /*
+     * Passes the name of the element to visit, unless visit is NULL.
+     */
+    void visit_element(const poset_state &state, poset_element_id elementId, jnp1::poset_visitor visit,
+                       void *context) {
+        if (visit != nullptr) {
+            visit(element_c_name(state, elementId), context);
+        }
+    }
+
+    /*
+     * Visits the minimal elements of the poset, or the maximal ones if transpose
+     * is false. Returns their number.
+     */
+    size_t visit_extreme_elements(const poset_state &state, bool transpose, jnp1::poset_visitor visit,
+                                  void *context) {
+        size_t count = 0;
+        for_each_element(state, [&](poset_element_id i) {
+            if (is_extreme(state, i, transpose)) {
+                visit_element(state, i, visit, context);
+                count++;
+            }
+        });
+
+        return count;
+    }
+
+    /*
+     * Visits the element and all the elements it precedes, or all the elements
+     * preceding it if transpose is true. Returns their number.
+     */
+    size_t visit_related_elements(const poset_state &state, poset_element_id elementId, bool transpose,
+                                  jnp1::poset_visitor visit, void *context) {
+        size_t count = 0;
+        for_each_related(state, elementId, transpose, [&](poset_element_id i) {
+            visit_element(state, i, visit, context);
+            count++;
+        });
+
+        return count;
+    }
+
+    /*
+     * Replaces the mapped image of the poset with ordinary rows and names,
+     * keeping ids of the elements. Assumes that the poset is locked exclusively.
+     */
+    void materialize_image(poset_state &state) {
+        shared_ptr<const poset_image> image = move(state.image);
+        size_t rowWords = image->row_words();
+
+        state.elements = poset();
+        state.names = make_shared<name_to_element_id>();
+        state.elementNames.clear();
+        state.elementNames.reserve(image->size());
+
+        for (poset_element_id i = 0; i < image->size(); i++) {
+            const relations_word *successors = image->successors(i);
+            const relations_word *predecessors = image->predecessors(i);
+            poset_relations &elementRelations = state.elements.append(rowWords);
+            copy_n(successors, rowWords, elementRelations.first.data());
+            copy_n(predecessors, rowWords, elementRelations.second.data());
+
+            // Names of an image are terminated by '\0'.
+            name_id nameId = intern_name(image->name(i).data());
+            (*state.names)[nameId] = i;
+            state.elementNames.push_back(nameId);
+        }
+
+        // Handles given out for the image stay valid.
+        state.elementGenerations.assign(image->size(), state.firstGeneration);
+        state.freeElementIds.clear();
+    }
+
+    /*
+     * Locks the poset for reading like poset_reader, replacing its mapped image
+     * with ordinary rows first, for the operations which do not read images.
+     */
+    poset_reader materialized_reader(poset_id id) {
+        while (true) {
+            {
+                poset_reader reader(id);
+                if (!reader || reader->image == nullptr) {
+                    return reader;
+                }
+            }
+
+            // A writer materializes the image, no one maps it again afterwards.
+            poset_writer writer(id);
+        }
+    }
+
+    /*
+     * Numbers the elements of the poset anew so that there are no gaps, keeping
+     * their order. Returns their ids in that order and sets newIds[i] to the new
+     * id of element i. Assumes that the poset is not a mapped image.
+     */
+    vector<poset_element_id> renumber_elements(const poset_state &state, vector<poset_element_id> &newIds) {
+        vector<poset_element_id> liveIds;
+        newIds.assign(state.elementNames.size(), INVALID_POSET_ELEMENT_ID);
+
+        for (poset_element_id i = 0; i < state.elementNames.size(); i++) {
+            if (state.elementNames[i] != INVALID_NAME_ID) {
+                newIds[i] = poset_element_id(liveIds.size());
+                liveIds.push_back(i);
+            }
+        }
+
+        return liveIds;
+    }
+
+    /*
+     * Renumbers the elements of the poset so that there are no gaps and no free
+     * ids, starting a new generation. Assumes that the poset is locked exclusively.
+     */
+    void compact_poset(poset_state &state) {
+        vector<poset_element_id> newIds;
+        vector<poset_element_id> liveIds = renumber_elements(state, newIds);
+
+        if (state.hasse != nullptr) {
+            state.hasse = state.hasse->renumbered(liveIds, newIds);
+        } else {
+            // New rows are built in a new arena, the old one is freed with the last snapshot sharing it.
+            size_t rowWords = (liveIds.size() + RELATIONS_WORD_BITS - 1) / RELATIONS_WORD_BITS;
+            poset compacted;
+
+            for (poset_element_id i : liveIds) {
+                const poset_relations &oldRelations = state.elements[i];
+                poset_relations &newRelations = compacted.append(rowWords);
+
+                for_each_relation(oldRelations.first, [&](poset_element_id j) {
+                    set_relation(newRelations.first.data(), newIds[j]);
+                });
+                for_each_relation(oldRelations.second, [&](poset_element_id j) {
+                    set_relation(newRelations.second.data(), newIds[j]);
+                });
+            }
+
+            state.elements = move(compacted);
+        }
+
+        auto names = make_shared<name_to_element_id>();
+        element_names elementNames;
+        elementNames.reserve(liveIds.size());
+        for (poset_element_id i : liveIds) {
+            (*names)[state.elementNames[i]] = newIds[i];
+            elementNames.push_back(state.elementNames[i]);
+        }
+
+        state.names = move(names);
+        state.elementNames = move(elementNames);
+        state.firstGeneration = next_generation(state);
+        state.elementGenerations.assign(liveIds.size(), state.firstGeneration);
+        state.freeElementIds.clear();
+    }
+
+    /*
+     * Writes the poset to the file in the format read by poset_image, numbering its
+     * elements anew so that there are no gaps. Returns true if the file was written.
+     * The image is written to a temporary file renamed over the file at the end,
+     * so posets loaded from the file keep mapping its old contents.
+     * Assumes that the poset is not a mapped image.
+     */
+    bool write_image(const poset_state &state, char const *path) {
+        vector<poset_element_id> newIds;
+        vector<poset_element_id> writtenIds = renumber_elements(state, newIds);
+
+        uint64_t elementCount = writtenIds.size();
+        uint64_t rowWords = (elementCount + RELATIONS_WORD_BITS - 1) / RELATIONS_WORD_BITS;
+        uint64_t slotCount = 1;
+        while (slotCount <= elementCount) {
+            slotCount *= 2;
+        }
+
+        vector<uint64_t> nameOffsets(1, 0);
+        vector<image_slot> slots(slotCount, 0);
+        string names;
+        {
+            shared_lock<shared_mutex> namesLock(internedNamesLock());
+
+            for (uint64_t i = 0; i < elementCount; i++) {
+                const poset_element_name &name = internedNames()[state.elementNames[writtenIds[i]]].first;
+                names.append(name);
+                names.push_back('\0');
+                nameOffsets.push_back(names.size());
+
+                uint64_t slot = image_name_hash(name) & (slotCount - 1);
+                while (slots[slot] != 0) {
+                    slot = (slot + 1) & (slotCount - 1);
+                }
+                slots[slot] = image_slot(i + 1);
+            }
+        }
+
+        // Temporary file in the same directory, so that rename replaces the file atomically.
+        static atomic<uint64_t> temporaryFiles{0};
+        string temporaryPath = string(path) + ".tmp." + to_string(getpid()) + "." + to_string(temporaryFiles++);
+        int descriptor = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (descriptor < 0) {
+            return false;
+        }
+
+        bool written = true;
+        auto write = [&descriptor, &written](const void *data, uint64_t size) {
+            const auto *bytes = static_cast<const char *>(data);
+            while (written && size > 0) {
+                ssize_t count = ::write(descriptor, bytes, size);
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                written = count > 0;
+                bytes += max<ssize_t>(count, 0);
+                size -= max<ssize_t>(count, 0);
+            }
+        };
+        const char padding[8] = {};
+        auto pad = [&write, &padding](uint64_t size) {
+            write(padding, image_padded(size) - size);
+        };
+
+        uint64_t header[POSET_IMAGE_HEADER_WORDS] = {POSET_IMAGE_MAGIC, POSET_IMAGE_VERSION, elementCount,
+                                                     rowWords, slotCount, names.size()};
+        write(header, sizeof(header));
+        write(nameOffsets.data(), nameOffsets.size() * sizeof(uint64_t));
+        write(slots.data(), slots.size() * sizeof(image_slot));
+        pad(slots.size() * sizeof(image_slot));
+
+        vector<relations_word> row(rowWords);
+        for (bool transpose : {false, true}) {
+            for (poset_element_id i : writtenIds) {
+                fill(row.begin(), row.end(), 0);
+                for_each_related(state, i, transpose, [&](poset_element_id j) {
+                    set_relation(row.data(), newIds[j]);
+                });
+                write(row.data(), rowWords * sizeof(relations_word));
+            }
+        }
+
+        write(names.data(), names.size());
+        pad(names.size());
+
+        written = fsync(descriptor) == 0 && written;
+        written = close(descriptor) == 0 && written;
+        if (!written || rename(temporaryPath.c_str(), path) != 0) {
+            unlink(temporaryPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+}
+
+namespace jnp1 {
+
+    unsigned long poset_new(void) {
+        TRACE(new, 0);
+        DEBUG("()");
+
+        poset_id newPosetId = nextPosetId++;
+
+        poset_registry_shard &shard = registry_shard(newPosetId);
+        unique_lock<shared_mutex> shardLock(shard.first);
+        shard.second.try_emplace(newPosetId);
+
+        traceScope.id_is(newPosetId);
+        DEBUG(": poset " << newPosetId << " created");
+
+        return newPosetId;
+    }
+
+    unsigned long poset_new_sparse(void) {
+        TRACE(new_sparse, 0);
+        DEBUG("()");
+
+        poset_id newPosetId = nextPosetId++;
+
+        poset_registry_shard &shard = registry_shard(newPosetId);
+        unique_lock<shared_mutex> shardLock(shard.first);
+        shard.second.try_emplace(newPosetId).first->second.hasse = make_shared<hasse_diagram>();
+
+        traceScope.id_is(newPosetId);
+        DEBUG(": sparse poset " << newPosetId << " created");
+
+        return newPosetId;
+    }
+
+    void poset_delete(unsigned long id) {
+        TRACE(delete, id);
+        DEBUG("(" << id << ")");
+
+        // Nobody else holds the poset while its shard is locked exclusively.
+        poset_registry_shard &shard = registry_shard(id);
+        unique_lock<shared_mutex> shardLock(shard.first);
+
+        auto posetToBeDeletedIterator = shard.second.find(id);
+        if (posetToBeDeletedIterator == shard.second.end()) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+            return;
+        }
+
+        release_names(*(posetToBeDeletedIterator->second).names);
+        shard.second.erase(posetToBeDeletedIterator);
+
+        DEBUG(": poset " << id << " deleted");
+    }
+
+    size_t poset_size(unsigned long id) {
+        TRACE(size, id);
+        DEBUG("(" << id << ")");
+
+        poset_reader sizedPoset(id);
+
+        if (!sizedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return 0;
+        }
+
+        size_t size = element_count(*sizedPoset);
+        DEBUG(": poset " << id << " contains " << size << " element(s)");
+
+        return size;
+    }
+
+    bool poset_insert(unsigned long id, char const *value) {
+        TRACE(insert, id);
+        DEBUG("(" << id << ", " << MAKE_STRING(value) << ")");
+
+        if (value == nullptr) {
+            RESULT(invalid_value, ": " << INVALID_VALUE(value));
+
+            return false;
+        }
+
+        poset_writer insertedPoset(id);
+        if (!insertedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return false;
+        }
+
+        if (find_element_id(*insertedPoset->names, value) != INVALID_POSET_ELEMENT_ID) {
+            RESULT(already_exists, ": poset " << id << ", element \"" << value << "\" already exists");
+
+            return false;
+        }
+
+        poset_element_id insertedElementId = allocate_element_id(*insertedPoset);
+        if (insertedPoset->hasse != nullptr) {
+            mutable_hasse(*insertedPoset).insert(insertedElementId);
+        } else {
+            insertedPoset->elements.insert(insertedElementId);
+        }
+
+        name_id insertedNameId = intern_name(value);
+        insertedPoset->elementNames[insertedElementId] = insertedNameId;
+
+        mutable_names(*insertedPoset)[insertedNameId] = insertedElementId;
+
+        DEBUG(": poset " << id << ", element \"" << value << "\" inserted");
+
+        return true;
+    }
+
+    bool poset_remove(unsigned long id, char const *value) {
+        TRACE(remove, id);
+        DEBUG("(" << id << ", " << MAKE_STRING(value) << ")");
+
+        if (value == nullptr) {
+            RESULT(invalid_value, ": " << INVALID_VALUE(value));
+
+            return false;
+        }
+
+        poset_writer removedFromPoset(id);
+        if (!removedFromPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return false;
+        }
+        poset &posetRemoveFrom = removedFromPoset->elements;
+
+
+        poset_element_id elementToBeRemovedId = find_element_id(*removedFromPoset->names, value);
+        if (elementToBeRemovedId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_NOT_EXIST(value));
+
+            return false;
+        }
+        remove_element_id(*removedFromPoset, elementToBeRemovedId);
+
+        if (removedFromPoset->hasse != nullptr) {
+            mutable_hasse(*removedFromPoset).remove(elementToBeRemovedId);
+        } else {
+            assert(elementToBeRemovedId < posetRemoveFrom.size());
+
+            const poset_relations elementToBeRemovedRelations = posetRemoveFrom[elementToBeRemovedId];
+
+            //Deleting all the relations that the element to be deleted is in
+            iterate_and_remove(elementToBeRemovedId, elementToBeRemovedRelations.first, posetRemoveFrom, false);
+
+            //Deleting all the transposed relations that the element to be deleted is in
+            iterate_and_remove(elementToBeRemovedId, elementToBeRemovedRelations.second, posetRemoveFrom, true);
+
+            //Releasing the rows, so that the id can be given to the next inserted element
+            posetRemoveFrom.remove(elementToBeRemovedId);
+        }
+
+        DEBUG(": poset " << id << ", element \"" << value << "\" removed");
+
+        return true;
+    }
+
+    bool poset_add(unsigned long id, char const *value1, char const *value2) {
+        TRACE(add, id);
+        DEBUG("(" << id << ", " << MAKE_STRING(value1) << ", " << MAKE_STRING(value2) << ")");
+
+        if (value1 == nullptr || value2 == nullptr) {
+            if (value1 == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(value1));
+            }
+            if (value2 == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(value2));
+            }
+            return false;
+        }
+
+        poset_writer addedToPoset(id);
+        if (!addedToPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+            return false;
+        }
+
+        poset_element_id firstElementId;
+        FIND_ELEMENT_ID(firstElementId, value1);
+
+        poset_element_id secondElementId;
+        FIND_ELEMENT_ID(secondElementId, value2);
+
+        if (in_relation(*addedToPoset, firstElementId, secondElementId, false)) {
+            RESULT(already_exists, ": poset " << id << ", " << RELATION(value1, value2) << " already exists");
+
+            return false;
+        }
+
+        if (in_relation(*addedToPoset, secondElementId, firstElementId, false)) {
+            RESULT(cannot_be_changed, ": poset " << id << ", " << RELATION(value1, value2) << " cannot be added");
+
+            return false;
+        }
+
+        extend_relation(*addedToPoset, firstElementId, secondElementId);
+
+        DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " added");
+
+        return true;
+    }
+
+    size_t poset_add_many(unsigned long id, char const *const *values1, char const *const *values2,
+                          size_t count, bool *results) {
+        TRACE(add_many, id);
+        DEBUG("(" << id << ", " << count << " relation(s))");
+
+        poset_writer addedToPoset(id);
+        if (!addedToPoset || values1 == nullptr || values2 == nullptr) {
+            if (!addedToPoset) {
+                RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+            } else {
+                RESULT(invalid_value, ": invalid values (NULL)");
+            }
+
+            if (results != nullptr) {
+                fill(results, results + count, false);
+            }
+            return 0;
+        }
+        poset_state &posetToBeAddedTo = *addedToPoset;
+
+        size_t added = 0;
+        for (size_t i = 0; i < count; i++) {
+            poset_element_id firstElementId = find_element_id(posetToBeAddedTo, values1[i]);
+            poset_element_id secondElementId = find_element_id(posetToBeAddedTo, values2[i]);
+
+            // Relations are added one by one, as each of them may decide whether the next one can be added.
+            bool canBeAdded = firstElementId != INVALID_POSET_ELEMENT_ID
+                              && secondElementId != INVALID_POSET_ELEMENT_ID
+                              && !in_relation(posetToBeAddedTo, firstElementId, secondElementId, false)
+                              && !in_relation(posetToBeAddedTo, secondElementId, firstElementId, false);
+
+            if (canBeAdded) {
+                extend_relation(posetToBeAddedTo, firstElementId, secondElementId);
+                added++;
+            }
+            if (results != nullptr) {
+                results[i] = canBeAdded;
+            }
+        }
+
+        DEBUG(": poset " << id << ", " << added << " of " << count << " relation(s) added");
+
+        return added;
+    }
+
+
+    bool poset_del(unsigned long id, char const *value1, char const *value2) {
+        TRACE(del, id);
+        DEBUG("(" << id << ", " << MAKE_STRING(value1) << ", " << MAKE_STRING(value2) << ")");
+        if (value1 == nullptr || value2 == nullptr) {
+            if (value1 == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(value1));
+            }
+            if (value2 == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(value2));
+            }
+
+            return false;
+        }
+
+        poset_writer removedFromPoset(id);
+        if (!removedFromPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return false;
+        }
+        poset &posetToBeRemovedFrom = removedFromPoset->elements;
+
+        poset_element_id firstElementId = find_element_id(*removedFromPoset->names, value1);
+        if (firstElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_NOT_EXIST(value1));
+
+            return false;
+        }
+        assert(firstElementId < removedFromPoset->elementNames.size());
+
+        poset_element_id secondElementId = find_element_id(*removedFromPoset->names, value2);
+        if (secondElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_NOT_EXIST(value2));
+
+            return false;
+        }
+        assert(secondElementId < removedFromPoset->elementNames.size());
+
+        //Every poset element must be in relation with itself
+        if (firstElementId == secondElementId) {
+            RESULT(cannot_be_changed, ": poset " << id << ", " << RELATION(value1, value2) << " cannot be deleted");
+
+            return false;
+        }
+
+        if (removedFromPoset->hasse != nullptr) {
+            if (!removedFromPoset->hasse->covers(firstElementId, secondElementId)) {
+                RESULT(cannot_be_changed, ": poset " << id << ", " << RELATION(value1, value2) << " cannot be deleted");
+
+                return false;
+            }
+
+            mutable_hasse(*removedFromPoset).remove_covering(firstElementId, secondElementId);
+            DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " deleted");
+
+            return true;
+        }
+
+        const relations &firstElementRelations = posetToBeRemovedFrom[firstElementId].first;
+        const relations &secondElementTransposedRelations = posetToBeRemovedFrom[secondElementId].second;
+
+        if (!test_relation(firstElementRelations, secondElementId)) {
+            RESULT(cannot_be_changed, ": poset " << id << ", " << RELATION(value1, value2) << " cannot be deleted");
+
+            return false;
+        }
+        assert(test_relation(secondElementTransposedRelations, firstElementId));
+
+        //Elements between are those following the first element and preceding the second one
+        if (rows_intersect(firstElementRelations, secondElementTransposedRelations, firstElementId, secondElementId)) {
+            RESULT(cannot_be_changed, ": poset " << id << ", " << RELATION(value1, value2) << " cannot be deleted");
+
+            return false;
+        }
+
+        reset_relation(posetToBeRemovedFrom.mutable_relations(firstElementId).first, secondElementId);
+        reset_relation(posetToBeRemovedFrom.mutable_relations(secondElementId).second, firstElementId);
+
+        DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " deleted");
+
+        return true;
+    }
+
+    bool poset_test(unsigned long id, char const *value1, char const *value2) {
+        TRACE(test, id);
+        DEBUG("(" << id << ", " << MAKE_STRING(value1) << ", " << MAKE_STRING(value2) << ")");
+        if (value1 == nullptr || value2 == nullptr) {
+            if (value1 == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(value1));
+            }
+            if (value2 == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(value2));
+            }
+
+            return false;
+        }
+
+        poset_reader testedPoset(id);
+        if (!testedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return false;
+        }
+        poset_element_id firstElementId = find_element_id(*testedPoset, value1);
+        if (firstElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_NOT_EXIST(value1));
+
+            return false;
+        }
+
+        poset_element_id secondElementId = find_element_id(*testedPoset, value2);
+        if (secondElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_NOT_EXIST(value2));
+
+            return false;
+        }
+
+        if (in_relation(*testedPoset, firstElementId, secondElementId)) {
+            DEBUG(": poset " << id << ", " << RELATION(value1, value2) << " exists");
+
+            return true;
+        } else {
+            RESULT(not_in_relation, ": poset " << id << ", " << RELATION(value1, value2) << " does not exist");
+
+            return false;
+        }
+    }
+
+    size_t poset_test_many(unsigned long id, char const *const *values1, char const *const *values2,
+                           size_t count, bool *results) {
+        TRACE(test_many, id);
+        DEBUG("(" << id << ", " << count << " relation(s))");
+
+        poset_reader testedPoset(id);
+        if (!testedPoset || values1 == nullptr || values2 == nullptr) {
+            if (!testedPoset) {
+                RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+            } else {
+                RESULT(invalid_value, ": invalid values (NULL)");
+            }
+
+            if (results != nullptr) {
+                fill(results, results + count, false);
+            }
+            return 0;
+        }
+        const poset_state &posetToBeTested = *testedPoset;
+
+        size_t existing = 0;
+        for (size_t i = 0; i < count; i++) {
+            poset_element_id firstElementId = find_element_id(posetToBeTested, values1[i]);
+            poset_element_id secondElementId = find_element_id(posetToBeTested, values2[i]);
+
+            bool exists = firstElementId != INVALID_POSET_ELEMENT_ID
+                          && secondElementId != INVALID_POSET_ELEMENT_ID
+                          && in_relation(posetToBeTested, firstElementId, secondElementId);
+
+            if (exists) {
+                existing++;
+            }
+            if (results != nullptr) {
+                results[i] = exists;
+            }
+        }
+
+        DEBUG(": poset " << id << ", " << existing << " of " << count << " relation(s) exist");
+
+        return existing;
+    }
+
+    uint64_t poset_lookup(unsigned long id, char const *value) {
+        TRACE(lookup, id);
+        DEBUG("(" << id << ", " << MAKE_STRING(value) << ")");
+
+        if (value == nullptr) {
+            RESULT(invalid_value, ": " << INVALID_VALUE(value));
+
+            return INVALID_POSET_ELEMENT_HANDLE;
+        }
+
+        poset_reader searchedPoset(id);
+        if (!searchedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return INVALID_POSET_ELEMENT_HANDLE;
+        }
+
+        poset_element_id elementId = find_element_id(*searchedPoset, value);
+        if (elementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_NOT_EXIST(value));
+
+            return INVALID_POSET_ELEMENT_HANDLE;
+        }
+
+        poset_element_handle handle = element_handle(*searchedPoset, elementId);
+        DEBUG(": poset " << id << ", element \"" << value << "\" has handle " << handle);
+
+        return handle;
+    }
+
+    bool poset_add_h(unsigned long id, uint64_t element1, uint64_t element2) {
+        TRACE(add_h, id);
+        DEBUG("(" << id << ", " << element1 << ", " << element2 << ")");
+
+        poset_writer addedToPoset(id);
+        if (!addedToPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+            return false;
+        }
+
+        poset_element_id firstElementId = find_element_id(*addedToPoset, element1);
+        if (firstElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_HANDLE_NOT_EXIST(element1));
+            return false;
+        }
+
+        poset_element_id secondElementId = find_element_id(*addedToPoset, element2);
+        if (secondElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_HANDLE_NOT_EXIST(element2));
+            return false;
+        }
+
+        if (in_relation(*addedToPoset, firstElementId, secondElementId, false)) {
+            RESULT(already_exists, ": poset " << id << ", "
+               << RELATION(element_name(*addedToPoset, firstElementId), element_name(*addedToPoset, secondElementId))
+               << " already exists");
+
+            return false;
+        }
+
+        if (in_relation(*addedToPoset, secondElementId, firstElementId, false)) {
+            RESULT(cannot_be_changed, ": poset " << id << ", "
+               << RELATION(element_name(*addedToPoset, firstElementId), element_name(*addedToPoset, secondElementId))
+               << " cannot be added");
+
+            return false;
+        }
+
+        extend_relation(*addedToPoset, firstElementId, secondElementId);
+
+        DEBUG(": poset " << id << ", "
+              << RELATION(element_name(*addedToPoset, firstElementId), element_name(*addedToPoset, secondElementId)) << " added");
+
+        return true;
+    }
+
+    bool poset_test_h(unsigned long id, uint64_t element1, uint64_t element2) {
+        TRACE(test_h, id);
+        DEBUG("(" << id << ", " << element1 << ", " << element2 << ")");
+
+        poset_reader testedPoset(id);
+        if (!testedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return false;
+        }
+        poset_element_id firstElementId = find_element_id(*testedPoset, element1);
+        if (firstElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_HANDLE_NOT_EXIST(element1));
+
+            return false;
+        }
+
+        poset_element_id secondElementId = find_element_id(*testedPoset, element2);
+        if (secondElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_HANDLE_NOT_EXIST(element2));
+
+            return false;
+        }
+
+        bool exists = in_relation(*testedPoset, firstElementId, secondElementId);
+        if (!exists) {
+            traceScope.outcome_is(poset_outcome_not_in_relation);
+        }
+        DEBUG(": poset " << id << ", "
+              << RELATION(element_name(*testedPoset, firstElementId), element_name(*testedPoset, secondElementId))
+              << (exists ? " exists" : " does not exist"));
+
+        return exists;
+    }
+
+    size_t poset_minimal(unsigned long id, poset_visitor visit, void *context) {
+        TRACE(minimal, id);
+        DEBUG("(" << id << ")");
+
+        poset_reader visitedPoset(id);
+        if (!visitedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return 0;
+        }
+
+        size_t count = visit_extreme_elements(*visitedPoset, true, visit, context);
+        DEBUG(": poset " << id << " has " << count << " minimal element(s)");
+
+        return count;
+    }
+
+    size_t poset_maximal(unsigned long id, poset_visitor visit, void *context) {
+        TRACE(maximal, id);
+        DEBUG("(" << id << ")");
+
+        poset_reader visitedPoset(id);
+        if (!visitedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return 0;
+        }
+
+        size_t count = visit_extreme_elements(*visitedPoset, false, visit, context);
+        DEBUG(": poset " << id << " has " << count << " maximal element(s)");
+
+        return count;
+    }
+
+    size_t poset_downset(unsigned long id, char const *value, poset_visitor visit, void *context) {
+        TRACE(downset, id);
+        DEBUG("(" << id << ", " << MAKE_STRING(value) << ")");
+
+        if (value == nullptr) {
+            RESULT(invalid_value, ": " << INVALID_VALUE(value));
+
+            return 0;
+        }
+
+        poset_reader visitedPoset(id);
+        if (!visitedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return 0;
+        }
+
+        poset_element_id elementId = find_element_id(*visitedPoset, value);
+        if (elementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_NOT_EXIST(value));
+
+            return 0;
+        }
+
+        size_t count = visit_related_elements(*visitedPoset, elementId, true, visit, context);
+        DEBUG(": poset " << id << ", element \"" << value << "\" follows " << count << " element(s)");
+
+        return count;
+    }
+
+    size_t poset_upset(unsigned long id, char const *value, poset_visitor visit, void *context) {
+        TRACE(upset, id);
+        DEBUG("(" << id << ", " << MAKE_STRING(value) << ")");
+
+        if (value == nullptr) {
+            RESULT(invalid_value, ": " << INVALID_VALUE(value));
+
+            return 0;
+        }
+
+        poset_reader visitedPoset(id);
+        if (!visitedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return 0;
+        }
+
+        poset_element_id elementId = find_element_id(*visitedPoset, value);
+        if (elementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": poset " << id << ", " << ELEMENT_NOT_EXIST(value));
+
+            return 0;
+        }
+
+        size_t count = visit_related_elements(*visitedPoset, elementId, false, visit, context);
+        DEBUG(": poset " << id << ", element \"" << value << "\" precedes " << count << " element(s)");
+
+        return count;
+    }
+
+    size_t poset_linear_extension(unsigned long id, poset_visitor visit, void *context) {
+        TRACE(linear_extension, id);
+        DEBUG("(" << id << ")");
+
+        poset_reader visitedPoset(id);
+        if (!visitedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return 0;
+        }
+
+        vector<poset_element_id> order = linear_extension(*visitedPoset);
+        for (poset_element_id i : order) {
+            visit_element(*visitedPoset, i, visit, context);
+        }
+
+        DEBUG(": poset " << id << ", " << order.size() << " element(s) ordered");
+
+        return order.size();
+    }
+
+    unsigned long poset_snapshot(unsigned long id) {
+        TRACE(snapshot, id);
+        DEBUG("(" << id << ")");
+
+        poset_snapshot_state snapshot;
+        {
+            poset_reader snapshotPoset = materialized_reader(id);
+            if (!snapshotPoset) {
+                RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+                return INVALID_SNAPSHOT_ID;
+            }
+
+            // Rows and names are shared, the poset copies them before changing them.
+            snapshot.posetId = id;
+            snapshot.elements = snapshotPoset->elements;
+            snapshot.epoch = snapshot.elements.share();
+            snapshot.names = snapshotPoset->names;
+            snapshot.hasse = snapshotPoset->hasse;
+
+            // Counted before the poset is unlocked, so that none of its names is forgotten.
+            unique_lock<shared_mutex> namesLock(internedNamesLock());
+            liveSnapshotCount++;
+        }
+
+        snapshot_id newSnapshotId = nextSnapshotId++;
+        {
+            unique_lock<shared_mutex> snapshotsMapLock(snapshotsLock());
+            snapshots().emplace(newSnapshotId, move(snapshot));
+        }
+
+        DEBUG(": poset " << id << ", snapshot " << newSnapshotId << " taken");
+
+        return newSnapshotId;
+    }
+
+    bool poset_snapshot_test(unsigned long snapshot, char const *value1, char const *value2) {
+        TRACE(snapshot_test, snapshot);
+        DEBUG("(" << snapshot << ", " << MAKE_STRING(value1) << ", " << MAKE_STRING(value2) << ")");
+        if (value1 == nullptr || value2 == nullptr) {
+            if (value1 == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(value1));
+            }
+            if (value2 == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(value2));
+            }
+
+            return false;
+        }
+
+        shared_lock<shared_mutex> snapshotsMapLock(snapshotsLock());
+
+        auto snapshotIterator = snapshots().find(snapshot);
+        if (snapshotIterator == snapshots().end()) {
+            RESULT(snapshot_not_exist, ": " << SNAPSHOT_NOT_EXIST(snapshot));
+
+            return false;
+        }
+        const poset_snapshot_state &testedSnapshot = snapshotIterator->second;
+
+        poset_element_id firstElementId = find_element_id(*testedSnapshot.names, value1);
+        if (firstElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": snapshot " << snapshot << ", " << ELEMENT_NOT_EXIST(value1));
+
+            return false;
+        }
+
+        poset_element_id secondElementId = find_element_id(*testedSnapshot.names, value2);
+        if (secondElementId == INVALID_POSET_ELEMENT_ID) {
+            RESULT(element_not_exist, ": snapshot " << snapshot << ", " << ELEMENT_NOT_EXIST(value2));
+
+            return false;
+        }
+
+        bool exists = testedSnapshot.hasse != nullptr
+                      ? testedSnapshot.hasse->reaches(firstElementId, secondElementId)
+                      : test_relation(testedSnapshot.elements[firstElementId].first, secondElementId);
+        if (!exists) {
+            traceScope.outcome_is(poset_outcome_not_in_relation);
+        }
+        DEBUG(": snapshot " << snapshot << ", " << RELATION(value1, value2)
+              << (exists ? " exists" : " does not exist"));
+
+        return exists;
+    }
+
+    void poset_snapshot_release(unsigned long snapshot) {
+        TRACE(snapshot_release, snapshot);
+        DEBUG("(" << snapshot << ")");
+
+        poset_snapshot_state releasedSnapshot;
+        {
+            unique_lock<shared_mutex> snapshotsMapLock(snapshotsLock());
+
+            auto snapshotIterator = snapshots().find(snapshot);
+            if (snapshotIterator == snapshots().end()) {
+                RESULT(snapshot_not_exist, ": " << SNAPSHOT_NOT_EXIST(snapshot));
+
+                return;
+            }
+
+            // Freed after unlocking, as it may hold the last copies of many rows.
+            releasedSnapshot = move(snapshotIterator->second);
+            snapshots().erase(snapshotIterator);
+        }
+
+        {
+            // Writers change rows in place once they are no longer shared. Dropping them
+            // under the poset lock orders the reads made through the snapshot before that.
+            poset_reader snapshotPoset(releasedSnapshot.posetId);
+            releasedSnapshot.elements.unshare(releasedSnapshot.epoch);
+            releasedSnapshot = poset_snapshot_state();
+        }
+
+        {
+            unique_lock<shared_mutex> namesLock(internedNamesLock());
+            assert(liveSnapshotCount > 0);
+
+            if (--liveSnapshotCount == 0) {
+                forget_retired_names();
+            }
+        }
+
+        DEBUG(": snapshot " << snapshot << " released");
+    }
+
+    bool poset_save(unsigned long id, char const *path) {
+        TRACE(save, id);
+        DEBUG("(" << id << ", " << MAKE_STRING(path) << ")");
+
+        if (path == nullptr) {
+            RESULT(invalid_value, ": " << INVALID_VALUE(path));
+
+            return false;
+        }
+
+        poset_reader savedPoset = materialized_reader(id);
+        if (!savedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return false;
+        }
+
+        if (!write_image(*savedPoset, path)) {
+            RESULT(file_error, ": poset " << id << " cannot be saved to \"" << path << "\"");
+
+            return false;
+        }
+
+        DEBUG(": poset " << id << " saved to \"" << path << "\"");
+
+        return true;
+    }
+
+    bool poset_load(char const *path, unsigned long *id) {
+        TRACE(load, 0);
+        DEBUG("(" << MAKE_STRING(path) << ")");
+
+        if (path == nullptr || id == nullptr) {
+            if (path == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(path));
+            }
+            if (id == nullptr) {
+                RESULT(invalid_value, ": " << INVALID_VALUE(id));
+            }
+
+            return false;
+        }
+
+        shared_ptr<const poset_image> image = poset_image::map_file(path);
+        if (image == nullptr) {
+            RESULT(file_error, ": " << FILE_INVALID(path));
+
+            return false;
+        }
+
+        poset_id newPosetId = nextPosetId++;
+        {
+            poset_registry_shard &shard = registry_shard(newPosetId);
+            unique_lock<shared_mutex> shardLock(shard.first);
+            (shard.second[newPosetId]).image = move(image);
+        }
+
+        traceScope.id_is(newPosetId);
+        DEBUG(": poset " << newPosetId << " loaded from \"" << path << "\"");
+
+        *id = newPosetId;
+        return true;
+    }
+
+    void poset_clear(unsigned long id) {
+        TRACE(clear, id);
+        DEBUG("(" << id << ")");
+
+        poset_writer clearedPoset(id);
+        if (!clearedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return;
+        }
+
+        poset &posetToBeCleared = clearedPoset->elements;
+
+        release_names(*clearedPoset->names);
+        clearedPoset->names = make_shared<name_to_element_id>();
+        clearedPoset->elementNames.clear();
+        clearedPoset->firstGeneration = next_generation(*clearedPoset);
+        clearedPoset->elementGenerations.clear();
+        clearedPoset->freeElementIds.clear();
+        // Rows are freed with their arena, at once.
+        posetToBeCleared = poset();
+        if (clearedPoset->hasse != nullptr) {
+            clearedPoset->hasse = make_shared<hasse_diagram>();
+        }
+
+        DEBUG(": poset " << id << " cleared");
+    }
+
+    void poset_compact(unsigned long id) {
+        TRACE(compact, id);
+        DEBUG("(" << id << ")");
+
+        poset_writer compactedPoset(id);
+        if (!compactedPoset) {
+            RESULT(poset_not_exist, ": " << POSET_NOT_EXIST(id));
+
+            return;
+        }
+
+        compact_poset(*compactedPoset);
+
+        DEBUG(": poset " << id << " compacted to " << compactedPoset->elementNames.size() << " element id(s)");
+    }
+
+    bool poset_trace_start(size_t capacity) {
+        DEBUG("(" << capacity << ")");
+
+        if (capacity == 0 || capacity > MAX_TRACE_CAPACITY) {
+            DEBUG(": capacity " << capacity << " is out of range");
+
+            return false;
+        }
+
+        size_t slots = 1;
+        while (slots < capacity) {
+            slots *= 2;
+        }
+
+        lock_guard<mutex> buffersLock(traceBuffersLock());
+        traceBuffers().push_back(make_unique<trace_buffer>(slots));
+        activeTraceBuffer.store(traceBuffers().back().get(), memory_order_release);
+
+        DEBUG(": tracing the last " << slots << " call(s)");
+
+        return true;
+    }
+
+    void poset_trace_stop(void) {
+        DEBUG("()");
+
+        activeTraceBuffer.store(nullptr, memory_order_release);
+
+        DEBUG(": tracing stopped");
+    }
+
+    bool poset_trace_dump(char const *path) {
+        DEBUG("(" << MAKE_STRING(path) << ")");
+
+        if (path == nullptr) {
+            DEBUG(": " << INVALID_VALUE(path));
+
+            return false;
+        }
+
+        lock_guard<mutex> buffersLock(traceBuffersLock());
+        if (traceBuffers().empty()) {
+            DEBUG(": nothing was traced");
+
+            return false;
+        }
+
+        ofstream file(path, ios::trunc);
+        file << "# number operation id outcome latency_ns\n";
+        traceBuffers().back()->for_each_record([&file](uint64_t number, trace_operation operation,
+                                                       trace_outcome outcome, uint64_t id, uint64_t latency) {
+            file << number << ' ' << TRACE_OPERATION_NAMES[size_t(operation)] << ' ' << id << ' '
+                 << TRACE_OUTCOME_NAMES[size_t(outcome)] << ' ' << latency << '\n';
+        });
+        file.close();
+
+        if (file.fail()) {
+            DEBUG(": trace cannot be written to \"" << path << "\"");
+
+            return false;
+        }
+
+        DEBUG(": trace written to \"" << path << "\"");
+
+        return true;
+    }
+
+    void poset_metrics_start(void) {
+        DEBUG("()");
+
+        metricsEnabled.store(false, memory_order_relaxed);
+        for (metrics_stripe &stripe : metricsStripes) {
+            for (operation_metrics &metrics : stripe) {
+                for (atomic<uint64_t> &count : metrics.outcomes) {
+                    count.store(0, memory_order_relaxed);
+                }
+                metrics.latencyTotal.store(0, memory_order_relaxed);
+                for (atomic<uint64_t> &count : metrics.latency) {
+                    count.store(0, memory_order_relaxed);
+                }
+            }
+        }
+        metricsEnabled.store(true, memory_order_relaxed);
+
+        DEBUG(": metrics started");
+    }
+
+    void poset_metrics_stop(void) {
+        DEBUG("()");
+
+        metricsEnabled.store(false, memory_order_relaxed);
+
+        DEBUG(": metrics stopped");
+    }
+
+    bool poset_metrics_read(struct poset_metrics *metrics) {
+        DEBUG("(" << metrics << ")");
+
+        if (metrics == nullptr) {
+            DEBUG(": " << INVALID_VALUE(metrics));
+
+            return false;
+        }
+
+        memset(metrics, 0, sizeof(*metrics));
+        for (const metrics_stripe &stripe : metricsStripes) {
+            for (size_t operation = 0; operation < POSET_OPERATION_COUNT; operation++) {
+                const operation_metrics &operationMetrics = stripe[operation];
+
+                for (size_t outcome = 0; outcome < POSET_OUTCOME_COUNT; outcome++) {
+                    uint64_t count = operationMetrics.outcomes[outcome].load(memory_order_relaxed);
+                    metrics->outcomes[operation][outcome] += count;
+                    metrics->calls[operation] += count;
+                }
+                metrics->latency_total[operation] += operationMetrics.latencyTotal.load(memory_order_relaxed);
+                for (size_t bucket = 0; bucket < POSET_LATENCY_BUCKETS; bucket++) {
+                    metrics->latency[operation][bucket] += operationMetrics.latency[bucket].load(memory_order_relaxed);
+                }
+            }
+        }
+
+        DEBUG(": metrics read");
+
+        return true;
+    }
+
+    uint64_t poset_latency_bucket_start(size_t bucket) {
+        if (bucket < 2 * LATENCY_SUB_BUCKETS) {
+            return bucket;
+        }
+
+        uint64_t exponent = bucket / LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKET_BITS - 1;
+        return (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << (exponent - LATENCY_SUB_BUCKET_BITS);
+    }
+}
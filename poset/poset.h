@@ -6,12 +6,14 @@
 #ifdef __cplusplus
 
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 
 namespace jnp1 {
 extern "C" {
 #else
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #endif
@@ -26,6 +28,147 @@ bool poset_del(unsigned long id, char const *value1, char const *value2);
 bool poset_test(unsigned long id, char const *value1, char const *value2);
 void poset_clear(unsigned long id);
 
+/*
+ * Batched poset_add and poset_test: the i-th pair is (values1[i], values2[i]).
+ * Pairs are processed in order, as by consecutive single calls. If results
+ * is not NULL, results[i] receives the result for the i-th pair.
+ * Return the number of pairs with the result true.
+ */
+size_t poset_add_many(unsigned long id, char const *const *values1, char const *const *values2,
+                      size_t count, bool *results);
+size_t poset_test_many(unsigned long id, char const *const *values1, char const *const *values2,
+                       size_t count, bool *results);
+
+/*
+ * Handle API: poset_lookup returns a handle of the element value of the poset
+ * or 0 if there is no such element. poset_add_h and poset_test_h behave like
+ * poset_add and poset_test but take handles instead of names. A handle is
+ * valid until its element is removed or the poset is cleared, compacted or
+ * deleted. Ids of removed elements are reused, but their old handles are not.
+ */
+uint64_t poset_lookup(unsigned long id, char const *value);
+bool poset_add_h(unsigned long id, uint64_t element1, uint64_t element2);
+bool poset_test_h(unsigned long id, uint64_t element1, uint64_t element2);
+
+/*
+ * Queries streaming elements of the poset: each of them passes the name of every
+ * element it finds to visit, together with context, and returns the number of
+ * such elements, 0 if the poset or the element does not exist. visit may be NULL
+ * to count the elements only. poset_minimal and poset_maximal find the elements
+ * with no other element below or above them. poset_downset and poset_upset find
+ * the elements preceding or following value, value included. poset_linear_extension
+ * passes all the elements so that each of them comes after the elements preceding
+ * it. The poset stays locked while visit runs, so visit must not call any of
+ * these functions. A name passed to visit is valid only until visit returns.
+ */
+typedef void (*poset_visitor)(char const *value, void *context);
+
+size_t poset_minimal(unsigned long id, poset_visitor visit, void *context);
+size_t poset_maximal(unsigned long id, poset_visitor visit, void *context);
+size_t poset_downset(unsigned long id, char const *value, poset_visitor visit, void *context);
+size_t poset_upset(unsigned long id, char const *value, poset_visitor visit, void *context);
+size_t poset_linear_extension(unsigned long id, poset_visitor visit, void *context);
+
+/*
+ * Snapshots: poset_snapshot returns id of a read-only view of the poset as it is
+ * now, or 0 if the poset does not exist. poset_snapshot_test behaves like
+ * poset_test on that view and never waits for writers of the poset.
+ * poset_snapshot_release frees the snapshot.
+ */
+unsigned long poset_snapshot(unsigned long id);
+bool poset_snapshot_test(unsigned long snapshot, char const *value1, char const *value2);
+void poset_snapshot_release(unsigned long snapshot);
+
+/*
+ * Persistence: poset_save writes the poset to the file at path. poset_load maps
+ * such a file into memory as a new poset and stores its id in *id. The loaded
+ * poset answers poset_test and poset_size straight from the file and is read
+ * into memory on its first change. Return true on success.
+ */
+bool poset_save(unsigned long id, char const *path);
+bool poset_load(char const *path, unsigned long *id);
+
+/*
+ * Sparse posets: poset_new_sparse creates a poset which keeps only the covering
+ * relations (its Hasse diagram) and an index answering poset_test, so its memory
+ * grows with the number of covering relations rather than the square of the
+ * number of elements. It is used with all the functions above like any other
+ * poset. A change makes the next query rebuild the index, so sparse posets suit
+ * workloads which change them rarely between queries. poset_load of a saved
+ * sparse poset creates an ordinary one.
+ */
+unsigned long poset_new_sparse(void);
+
+/*
+ * Renumbers the elements of the poset so that their ids have no gaps left by
+ * removed elements. Handles of the poset given out before are not valid anymore.
+ */
+void poset_compact(unsigned long id);
+
+/*
+ * Tracing: poset_trace_start makes the functions above record their calls to a
+ * ring buffer keeping the last capacity calls (rounded up to a power of two,
+ * at most 2^24): the function, id of the poset or snapshot, the outcome and the
+ * time the call took. Recording never waits for other threads, and costs a single
+ * check while tracing is off. poset_trace_stop turns it off. poset_trace_dump
+ * writes the calls kept by the last trace to the file at path, one per line,
+ * oldest first. Return true on success.
+ */
+bool poset_trace_start(size_t capacity);
+void poset_trace_stop(void);
+bool poset_trace_dump(char const *path);
+
+/*
+ * Functions of the library, named without their poset_ prefix, and the outcomes
+ * of their calls, as counted by the metrics: poset_operation_add (of poset_add),
+ * ..., poset_outcome_done, poset_outcome_poset_not_exist, ...
+ */
+#define POSET_OPERATIONS(X) X(new) X(new_sparse) X(delete) X(size) X(insert) X(remove) X(add) X(add_many) \
+    X(del) X(test) X(test_many) X(lookup) X(add_h) X(test_h) X(minimal) X(maximal) X(downset) X(upset) \
+    X(linear_extension) X(snapshot) X(snapshot_test) X(snapshot_release) X(save) X(load) X(clear) X(compact)
+#define POSET_OUTCOMES(X) X(done) X(poset_not_exist) X(element_not_exist) X(snapshot_not_exist) X(invalid_value) \
+    X(already_exists) X(cannot_be_changed) X(not_in_relation) X(file_error)
+
+#define POSET_OPERATION_ENUMERATOR(name) poset_operation_##name,
+#define POSET_OUTCOME_ENUMERATOR(name) poset_outcome_##name,
+enum poset_operation {
+    POSET_OPERATIONS(POSET_OPERATION_ENUMERATOR)
+    POSET_OPERATION_COUNT
+};
+
+enum poset_outcome {
+    POSET_OUTCOMES(POSET_OUTCOME_ENUMERATOR)
+    POSET_OUTCOME_COUNT
+};
+#undef POSET_OPERATION_ENUMERATOR
+#undef POSET_OUTCOME_ENUMERATOR
+
+/// Latency buckets of the metrics, see poset_latency_bucket_start.
+#define POSET_LATENCY_BUCKETS 328
+
+struct poset_metrics {
+    uint64_t calls[POSET_OPERATION_COUNT];
+    uint64_t outcomes[POSET_OPERATION_COUNT][POSET_OUTCOME_COUNT];
+    /// Sum of the latencies in nanoseconds.
+    uint64_t latency_total[POSET_OPERATION_COUNT];
+    uint64_t latency[POSET_OPERATION_COUNT][POSET_LATENCY_BUCKETS];
+};
+
+/*
+ * Metrics: poset_metrics_start zeroes the metrics and makes the functions above
+ * count their calls by outcome and by latency, poset_metrics_stop stops it.
+ * Bucket i of the latency histogram counts the calls which took at least
+ * poset_latency_bucket_start(i) and less than poset_latency_bucket_start(i + 1)
+ * nanoseconds, so that buckets are at most 1/8 of their start wide (the last one
+ * has no upper bound). Counting never waits for other threads, and costs a single
+ * check while metrics are off. poset_metrics_read stores the metrics counted
+ * so far in *metrics and returns true on success.
+ */
+void poset_metrics_start(void);
+void poset_metrics_stop(void);
+bool poset_metrics_read(struct poset_metrics *metrics);
+uint64_t poset_latency_bucket_start(size_t bucket);
+
 #ifdef __cplusplus
     }
 }
@@ -0,0 +1,491 @@
+// Authors: Piotr Jasinski and Alicja Ziarko
+
+/*
+ * Benchmarks of the poset library. Results are written to the standard output
+ * as JSON in the format of Google Benchmark, so that its tools can compare runs.
+ *
+ * Build: g++ -std=c++17 -O2 -DNDEBUG poset.cc poset_benchmark.cc -o poset_benchmark -pthread
+ * Usage: poset_benchmark [--max-size N] [--dense-limit N] [--min-time SECONDS]
+ *                        [--threads N] [--filter TEXT]
+ *
+ * Sizes go from 100 to --max-size elements by powers of ten. Posets whose closure
+ * grows with the square of their size (chains, random DAGs, trees) are benchmarked
+ * as ordinary posets up to --dense-limit elements only. The bit row kernel is
+ * chosen with POSET_OR_KERNEL (scalar, sse2 or avx2), which is recorded in the context.
+ *
+ * Heap allocations are counted by the replaced operator new. The test_allocations
+ * cases query posets with poset_test after warm-up queries and report the allocations
+ * per query, the benchmark exits with status 1 if there were any.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "poset.h"
+
+namespace {
+    std::atomic<size_t> allocations(0);
+}
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+    struct options {
+        size_t maxSize = 100000;
+        size_t denseLimit = 10000;
+        double minTime = 0.2;
+        unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        std::string filter;
+    };
+
+    struct result {
+        std::string name;
+        size_t iterations;
+        double realTime;
+        double cpuTime;
+        unsigned threads;
+        double allocations;
+    };
+
+    using name_pairs = std::vector<std::pair<char const *, char const *>>;
+
+    options benchmarkOptions;
+    std::vector<result> results;
+    /// Names of the test_allocations cases whose queries allocated memory.
+    std::vector<std::string> allocatingQueries;
+
+    /// Names of the elements, element i is called "element<i>". Names never move once created.
+    const std::deque<std::string> &names(size_t count) {
+        static std::deque<std::string> names;
+        while (names.size() < count) {
+            names.push_back("element" + std::to_string(names.size()));
+        }
+        return names;
+    }
+
+    char const *name(size_t element) {
+        return names(element + 1)[element].c_str();
+    }
+
+    unsigned long new_poset(bool sparse) {
+        return sparse ? jnp1::poset_new_sparse() : jnp1::poset_new();
+    }
+
+    std::string poset_kind(bool sparse) {
+        return sparse ? "sparse" : "dense";
+    }
+
+    bool selected(const std::string &benchmarkName) {
+        return benchmarkName.find(benchmarkOptions.filter) != std::string::npos;
+    }
+
+    void insert_elements(unsigned long id, size_t size) {
+        for (size_t element = 0; element < size; element++) {
+            jnp1::poset_insert(id, name(element));
+        }
+    }
+
+    /// Relations of the posets benchmarked, added in the order given.
+    name_pairs chain(size_t size) {
+        name_pairs relations;
+        for (size_t element = 0; element + 1 < size; element++) {
+            relations.emplace_back(name(element), name(element + 1));
+        }
+        return relations;
+    }
+
+    /// Disjoint pairs of elements: an antichain of relations which never grow the closure.
+    name_pairs matching(size_t size) {
+        name_pairs relations;
+        for (size_t element = 0; element + 1 < size; element += 2) {
+            relations.emplace_back(name(element), name(element + 1));
+        }
+        return relations;
+    }
+
+    /// Two random relations per element, each from a lower to a higher element.
+    name_pairs random_dag(size_t size) {
+        std::mt19937 generator(size);
+        name_pairs relations;
+        for (size_t relation = 0; size > 1 && relation < 2 * size; relation++) {
+            size_t element1 = generator() % size;
+            size_t element2 = generator() % size;
+            if (element1 != element2) {
+                relations.emplace_back(name(std::min(element1, element2)), name(std::max(element1, element2)));
+            }
+        }
+        return relations;
+    }
+
+    /// Deep and narrow taxonomy: element i is below its parent (i - 1) / 4.
+    name_pairs tree(size_t size) {
+        name_pairs relations;
+        for (size_t element = 1; element < size; element++) {
+            relations.emplace_back(name((element - 1) / 4), name(element));
+        }
+        return relations;
+    }
+
+    void add_relations(unsigned long id, const name_pairs &relations) {
+        for (const auto &relation : relations) {
+            jnp1::poset_add(id, relation.first, relation.second);
+        }
+    }
+
+    /// Random pairs of the relations given, which are in relation, reversed, which are not.
+    name_pairs query_pairs(const name_pairs &relations, bool reversed) {
+        std::mt19937 generator(relations.size());
+        name_pairs queries;
+        for (size_t query = 0; !relations.empty() && query < 4096; query++) {
+            auto relation = relations[generator() % relations.size()];
+            queries.push_back(reversed ? std::make_pair(relation.second, relation.first) : relation);
+        }
+        return queries;
+    }
+
+    double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void report(const std::string &benchmarkName, size_t iterations, double realSeconds, double cpuSeconds,
+                unsigned threads = 1, size_t allocationCount = 0) {
+        results.push_back({benchmarkName, iterations, realSeconds * 1e9 / double(iterations),
+                           cpuSeconds * 1e9 / double(iterations), threads,
+                           double(allocationCount) / double(iterations)});
+        std::cerr << benchmarkName << ": " << results.back().realTime << " ns, "
+                  << results.back().allocations << " allocations" << std::endl;
+    }
+
+    /*
+     * Runs setup on a new poset and then body on it, until body took at least
+     * --min-time in total, and reports the time of body per operation. If fresh
+     * is false, the poset is set up once and body is repeated on it.
+     * Returns the number of allocations made by body.
+     */
+    template<typename Setup, typename Body>
+    size_t run(const std::string &benchmarkName, bool sparse, bool fresh, size_t operations, Setup setup, Body body) {
+        if (!selected(benchmarkName) || operations == 0) {
+            return 0;
+        }
+
+        unsigned long id = 0;
+        double realSeconds = 0, cpuSeconds = 0;
+        size_t iterations = 0;
+        size_t allocationCount = 0;
+
+        do {
+            if (fresh || id == 0) {
+                if (id != 0) {
+                    jnp1::poset_delete(id);
+                }
+                id = new_poset(sparse);
+                setup(id);
+            }
+
+            std::clock_t cpuStart = std::clock();
+            size_t allocationStart = allocations.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            body(id);
+            realSeconds += seconds_since(start);
+            allocationCount += allocations.load(std::memory_order_relaxed) - allocationStart;
+            cpuSeconds += double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+            iterations += operations;
+        } while (realSeconds < benchmarkOptions.minTime);
+
+        jnp1::poset_delete(id);
+        report(benchmarkName, iterations, realSeconds, cpuSeconds, 1, allocationCount);
+        return allocationCount;
+    }
+
+    void benchmark_insert(bool sparse, size_t size) {
+        run("insert/" + poset_kind(sparse) + "/" + std::to_string(size), sparse, true, size,
+            [](unsigned long) {},
+            [size](unsigned long id) { insert_elements(id, size); });
+    }
+
+    void benchmark_add(const std::string &shape, const name_pairs &relations, bool sparse, size_t size) {
+        run("add_" + shape + "/" + poset_kind(sparse) + "/" + std::to_string(size), sparse, true, relations.size(),
+            [size](unsigned long id) { insert_elements(id, size); },
+            [&relations](unsigned long id) { add_relations(id, relations); });
+    }
+
+    void benchmark_test(const std::string &shape, const name_pairs &relations, bool sparse, size_t size) {
+        for (bool hit : {true, false}) {
+            name_pairs queries = query_pairs(relations, !hit);
+            run(std::string("test_") + (hit ? "hit_" : "miss_") + shape + "/" + poset_kind(sparse) + "/"
+                + std::to_string(size), sparse, false, queries.size(),
+                [size, &relations](unsigned long id) {
+                    insert_elements(id, size);
+                    add_relations(id, relations);
+                },
+                [&queries](unsigned long id) {
+                    for (const auto &query : queries) {
+                        jnp1::poset_test(id, query.first, query.second);
+                    }
+                });
+        }
+    }
+
+    /*
+     * Queries pairs in relation and not in relation and checks that poset_test
+     * allocates no memory. The queries are made once before the measurement, so that
+     * sparse posets build their index and the search space of the thread.
+     */
+    void benchmark_test_allocations(const std::string &shape, const name_pairs &relations, bool sparse,
+                                    size_t size) {
+        std::string benchmarkName = "test_allocations_" + shape + "/" + poset_kind(sparse) + "/" + std::to_string(size);
+        name_pairs queries = query_pairs(relations, false);
+        name_pairs misses = query_pairs(relations, true);
+        queries.insert(queries.end(), misses.begin(), misses.end());
+
+        size_t allocationCount = run(benchmarkName, sparse, false, queries.size(),
+            [size, &relations, &queries](unsigned long id) {
+                insert_elements(id, size);
+                add_relations(id, relations);
+                for (const auto &query : queries) {
+                    jnp1::poset_test(id, query.first, query.second);
+                }
+            },
+            [&queries](unsigned long id) {
+                for (const auto &query : queries) {
+                    jnp1::poset_test(id, query.first, query.second);
+                }
+            });
+        if (allocationCount != 0) {
+            allocatingQueries.push_back(benchmarkName);
+        }
+    }
+
+    void benchmark_del(bool sparse, size_t size) {
+        name_pairs relations = matching(size);
+        run("del/" + poset_kind(sparse) + "/" + std::to_string(size), sparse, true, relations.size(),
+            [size, &relations](unsigned long id) {
+                insert_elements(id, size);
+                add_relations(id, relations);
+            },
+            [&relations](unsigned long id) {
+                for (const auto &relation : relations) {
+                    jnp1::poset_del(id, relation.first, relation.second);
+                }
+            });
+    }
+
+    /*
+     * Deletes and adds back a relation (element0, element1) of an element related to
+     * all the others, so that poset_del cannot stop at the first element in between.
+     */
+    void benchmark_del_wide(bool sparse, size_t size) {
+        const size_t roundTrips = 100;
+        run("del_wide/" + poset_kind(sparse) + "/" + std::to_string(size), sparse, false, 2 * roundTrips,
+            [size](unsigned long id) {
+                insert_elements(id, size);
+                for (size_t element = 1; element < size; element++) {
+                    jnp1::poset_add(id, name(0), name(element));
+                }
+            },
+            [](unsigned long id) {
+                for (size_t roundTrip = 0; roundTrip < roundTrips; roundTrip++) {
+                    jnp1::poset_del(id, name(0), name(1));
+                    jnp1::poset_add(id, name(0), name(1));
+                }
+            });
+    }
+
+    void benchmark_remove(const std::string &shape, const name_pairs &relations, bool sparse, size_t size) {
+        std::vector<size_t> order(size);
+        for (size_t element = 0; element < size; element++) {
+            order[element] = element;
+        }
+        std::shuffle(order.begin(), order.end(), std::mt19937(size));
+
+        run("remove_" + shape + "/" + poset_kind(sparse) + "/" + std::to_string(size), sparse, true, size,
+            [size, &relations](unsigned long id) {
+                insert_elements(id, size);
+                add_relations(id, relations);
+            },
+            [&order](unsigned long id) {
+                for (size_t element : order) {
+                    jnp1::poset_remove(id, name(element));
+                }
+            });
+    }
+
+    /*
+     * Queries the same poset from 1, 2, 4, ... threads at once and reports the time
+     * per query of all the threads together, so that it falls as the queries scale.
+     */
+    void benchmark_test_threads(bool sparse, size_t size) {
+        std::string benchmarkName = "test_threads/" + poset_kind(sparse) + "/" + std::to_string(size);
+        if (!selected(benchmarkName)) {
+            return;
+        }
+
+        name_pairs relations = tree(size);
+        name_pairs queries = query_pairs(relations, false);
+        name_pairs misses = query_pairs(relations, true);
+        queries.insert(queries.end(), misses.begin(), misses.end());
+
+        unsigned long id = new_poset(sparse);
+        insert_elements(id, size);
+        add_relations(id, relations);
+
+        for (unsigned threads = 1; threads <= benchmarkOptions.maxThreads; threads *= 2) {
+            const size_t rounds = 64;
+            std::atomic<unsigned> ready(0);
+            std::atomic<bool> started(false);
+            std::vector<std::thread> workers;
+
+            for (unsigned thread = 0; thread < threads; thread++) {
+                workers.emplace_back([id, &queries, &ready, &started]() {
+                    ready++;
+                    while (!started) {
+                        std::this_thread::yield();
+                    }
+                    for (size_t round = 0; round < rounds; round++) {
+                        for (const auto &query : queries) {
+                            jnp1::poset_test(id, query.first, query.second);
+                        }
+                    }
+                });
+            }
+
+            while (ready < threads) {
+                std::this_thread::yield();
+            }
+            std::clock_t cpuStart = std::clock();
+            auto start = std::chrono::steady_clock::now();
+            started = true;
+            for (std::thread &worker : workers) {
+                worker.join();
+            }
+            double realSeconds = seconds_since(start);
+            double cpuSeconds = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+            report(benchmarkName + "/threads:" + std::to_string(threads), threads * rounds * queries.size(),
+                   realSeconds, cpuSeconds, threads);
+        }
+
+        jnp1::poset_delete(id);
+    }
+
+    void print_json() {
+        char const *kernel = std::getenv("POSET_OR_KERNEL");
+
+        std::cout << "{\n  \"context\": {\n"
+                  << "    \"executable\": \"poset_benchmark\",\n"
+                  << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+                  << "    \"or_kernel\": \"" << (kernel == nullptr ? "auto" : kernel) << "\"\n"
+                  << "  },\n  \"benchmarks\": [";
+
+        for (size_t index = 0; index < results.size(); index++) {
+            const result &benchmark = results[index];
+            std::cout << (index == 0 ? "\n" : ",\n")
+                      << "    {\n"
+                      << "      \"name\": \"" << benchmark.name << "\",\n"
+                      << "      \"run_name\": \"" << benchmark.name << "\",\n"
+                      << "      \"run_type\": \"iteration\",\n"
+                      << "      \"iterations\": " << benchmark.iterations << ",\n"
+                      << "      \"real_time\": " << benchmark.realTime << ",\n"
+                      << "      \"cpu_time\": " << benchmark.cpuTime << ",\n"
+                      << "      \"time_unit\": \"ns\",\n"
+                      << "      \"threads\": " << benchmark.threads << ",\n"
+                      << "      \"allocations_per_iteration\": " << benchmark.allocations << ",\n"
+                      << "      \"items_per_second\": " << 1e9 / benchmark.realTime << "\n"
+                      << "    }";
+        }
+
+        std::cout << "\n  ]\n}" << std::endl;
+    }
+
+    bool parse_options(int argc, char *argv[]) {
+        for (int argument = 1; argument + 1 < argc; argument += 2) {
+            std::string option = argv[argument];
+            char const *value = argv[argument + 1];
+
+            if (option == "--max-size") {
+                benchmarkOptions.maxSize = std::strtoull(value, nullptr, 10);
+            } else if (option == "--dense-limit") {
+                benchmarkOptions.denseLimit = std::strtoull(value, nullptr, 10);
+            } else if (option == "--min-time") {
+                benchmarkOptions.minTime = std::strtod(value, nullptr);
+            } else if (option == "--threads") {
+                benchmarkOptions.maxThreads = std::max(1ul, std::strtoul(value, nullptr, 10));
+            } else if (option == "--filter") {
+                benchmarkOptions.filter = value;
+            } else {
+                return false;
+            }
+        }
+
+        return argc % 2 == 1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (!parse_options(argc, argv)) {
+        std::cerr << "Usage: " << argv[0] << " [--max-size N] [--dense-limit N] [--min-time SECONDS]"
+                  << " [--threads N] [--filter TEXT]" << std::endl;
+        return 1;
+    }
+
+    for (size_t size = 100; size <= benchmarkOptions.maxSize; size *= 10) {
+        for (bool sparse : {false, true}) {
+            // Closure of the ordinary posets of these shapes grows with the square of their size.
+            bool closureFits = sparse || size <= benchmarkOptions.denseLimit;
+
+            name_pairs pairs = matching(size);
+            benchmark_insert(sparse, size);
+            benchmark_add("antichain", pairs, sparse, size);
+            benchmark_test("antichain", pairs, sparse, size);
+            benchmark_test_allocations("antichain", pairs, sparse, size);
+            benchmark_del(sparse, size);
+            benchmark_del_wide(sparse, size);
+            benchmark_remove("antichain", pairs, sparse, size);
+
+            if (closureFits) {
+                for (const auto &shape : {std::make_pair("chain", chain(size)),
+                                          std::make_pair("random_dag", random_dag(size)),
+                                          std::make_pair("tree", tree(size))}) {
+                    benchmark_add(shape.first, shape.second, sparse, size);
+                    benchmark_test(shape.first, shape.second, sparse, size);
+                    benchmark_test_allocations(shape.first, shape.second, sparse, size);
+                    benchmark_remove(shape.first, shape.second, sparse, size);
+                }
+                benchmark_test_threads(sparse, size);
+            }
+        }
+    }
+
+    print_json();
+
+    for (const std::string &benchmarkName : allocatingQueries) {
+        std::cerr << benchmarkName << ": poset_test allocated memory" << std::endl;
+    }
+
+    return allocatingQueries.empty() ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+// Authors: Piotr Jasinski and Alicja Ziarko
+
+/*
+ * Stress test of concurrent use of the poset library. Threads make random
+ * poset_new, poset_insert, poset_remove, poset_add, poset_del, poset_test and
+ * poset_delete calls on dense and sparse posets shared by all of them, and now
+ * and then replace a shared poset with a new one. After the threads are joined,
+ * every shared poset is checked to be reflexive on its elements, antisymmetric
+ * and transitive. Exits with status 1 if it is not.
+ *
+ * Build: g++ -std=c++17 -O2 poset.cc poset_stress.cc -o poset_stress -pthread
+ *        (add -fsanitize=thread -g to check for data races)
+ * Usage: POSET_DEBUG=0 poset_stress [--threads N] [--operations N] [--posets N]
+ *                                   [--elements N] [--seed N]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "poset.h"
+
+namespace {
+    struct options {
+        unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+        size_t operations = 20000;
+        size_t posets = 4;
+        size_t elements = 32;
+        unsigned seed = 1;
+    };
+
+    options stressOptions;
+
+    /// Names of the elements, element i is called "element<i>".
+    std::vector<std::string> names;
+
+    /// Ids of the shared posets, even slots hold dense posets and odd ones sparse posets.
+    std::deque<std::atomic<unsigned long>> posets;
+
+    unsigned long new_poset(size_t slot) {
+        return slot % 2 == 0 ? jnp1::poset_new() : jnp1::poset_new_sparse();
+    }
+
+    /// Makes random calls, the results cannot be checked as other threads change the posets meanwhile.
+    void run_thread(unsigned thread) {
+        std::mt19937 generator(stressOptions.seed * 1000003u + thread);
+
+        for (size_t operation = 0; operation < stressOptions.operations; operation++) {
+            size_t slot = generator() % posets.size();
+            unsigned long id = posets[slot].load();
+            char const *value1 = names[generator() % names.size()].c_str();
+            char const *value2 = names[generator() % names.size()].c_str();
+
+            switch (generator() % 16) {
+                case 0:
+                case 1:
+                case 2:
+                    jnp1::poset_insert(id, value1);
+                    break;
+                case 3:
+                    jnp1::poset_remove(id, value1);
+                    break;
+                case 4:
+                case 5:
+                case 6:
+                    jnp1::poset_add(id, value1, value2);
+                    break;
+                case 7:
+                case 8:
+                    jnp1::poset_del(id, value1, value2);
+                    break;
+                case 9: {
+                    // Poset used only by this thread.
+                    unsigned long own = jnp1::poset_new();
+                    jnp1::poset_insert(own, value1);
+                    jnp1::poset_insert(own, value2);
+                    jnp1::poset_add(own, value1, value2);
+                    jnp1::poset_test(own, value1, value2);
+                    jnp1::poset_delete(own);
+                    break;
+                }
+                case 10:
+                    // Rzadko, zeby posety zdazyly urosnac.
+                    if (generator() % 1024 == 0) {
+                        jnp1::poset_delete(posets[slot].exchange(new_poset(slot)));
+                    }
+                    break;
+                default:
+                    jnp1::poset_test(id, value1, value2);
+                    break;
+            }
+        }
+    }
+
+    /*
+     * Checks the relation of the poset, returns false and prints the violation if it
+     * is not a partial order. Adds the number of pairs in relation to relations.
+     */
+    bool check_poset(unsigned long id, size_t &relations) {
+        size_t count = names.size();
+        std::vector<char> related(count * count);
+        for (size_t i = 0; i < count; i++) {
+            for (size_t j = 0; j < count; j++) {
+                related[i * count + j] = jnp1::poset_test(id, names[i].c_str(), names[j].c_str());
+            }
+        }
+
+        size_t elements = 0;
+        for (size_t i = 0; i < count; i++) {
+            elements += related[i * count + i];
+        }
+        relations += size_t(std::count(related.begin(), related.end(), 1));
+        if (elements != jnp1::poset_size(id)) {
+            std::cerr << "poset " << id << ": " << jnp1::poset_size(id) << " elements, " << elements
+                      << " of them in relation with themselves" << std::endl;
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            for (size_t j = 0; j < count; j++) {
+                if (i != j && related[i * count + j] && related[j * count + i]) {
+                    std::cerr << "poset " << id << ": relations (" << names[i] << ", " << names[j]
+                              << ") and (" << names[j] << ", " << names[i] << ")" << std::endl;
+                    return false;
+                }
+                for (size_t k = 0; related[i * count + j] && k < count; k++) {
+                    if (related[j * count + k] && !related[i * count + k]) {
+                        std::cerr << "poset " << id << ": relations (" << names[i] << ", " << names[j]
+                                  << ") and (" << names[j] << ", " << names[k] << ") but not ("
+                                  << names[i] << ", " << names[k] << ")" << std::endl;
+                        return false;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool parse_options(int argc, char *argv[]) {
+        for (int argument = 1; argument + 1 < argc; argument += 2) {
+            std::string option = argv[argument];
+            char const *value = argv[argument + 1];
+
+            if (option == "--threads") {
+                stressOptions.threads = std::max(1ul, std::strtoul(value, nullptr, 10));
+            } else if (option == "--operations") {
+                stressOptions.operations = std::strtoull(value, nullptr, 10);
+            } else if (option == "--posets") {
+                stressOptions.posets = std::max(1ull, std::strtoull(value, nullptr, 10));
+            } else if (option == "--elements") {
+                stressOptions.elements = std::max(1ull, std::strtoull(value, nullptr, 10));
+            } else if (option == "--seed") {
+                stressOptions.seed = unsigned(std::strtoul(value, nullptr, 10));
+            } else {
+                return false;
+            }
+        }
+
+        return argc % 2 == 1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (!parse_options(argc, argv)) {
+        std::cerr << "Usage: " << argv[0] << " [--threads N] [--operations N] [--posets N]"
+                  << " [--elements N] [--seed N]" << std::endl;
+        return 2;
+    }
+
+    for (size_t element = 0; element < stressOptions.elements; element++) {
+        names.push_back("element" + std::to_string(element));
+    }
+    for (size_t slot = 0; slot < stressOptions.posets; slot++) {
+        posets.emplace_back(new_poset(slot));
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned thread = 0; thread < stressOptions.threads; thread++) {
+        threads.emplace_back(run_thread, thread);
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    bool valid = true;
+    size_t relations = 0;
+    for (std::atomic<unsigned long> &id : posets) {
+        valid = check_poset(id.load(), relations) && valid;
+        jnp1::poset_delete(id.load());
+    }
+
+    if (valid) {
+        std::cout << stressOptions.threads << " threads made " << stressOptions.operations
+                  << " calls each, posets are partial orders with " << relations << " pairs in relation"
+                  << std::endl;
+    }
+
+    return valid ? 0 : 1;
+}